@@ -53,8 +53,53 @@ namespace BinaryData
     extern const char*   main_png;
     const int            main_pngSize = 599;
 
+    extern const char*   wavetable_triangle_44100_bin;
+    const int            wavetable_triangle_44100_binSize = 17308;
+
+    extern const char*   wavetable_sawtooth_44100_bin;
+    const int            wavetable_sawtooth_44100_binSize = 17308;
+
+    extern const char*   wavetable_square_44100_bin;
+    const int            wavetable_square_44100_binSize = 17308;
+
+    extern const char*   wavetable_triangle_48000_bin;
+    const int            wavetable_triangle_48000_binSize = 17308;
+
+    extern const char*   wavetable_sawtooth_48000_bin;
+    const int            wavetable_sawtooth_48000_binSize = 17308;
+
+    extern const char*   wavetable_square_48000_bin;
+    const int            wavetable_square_48000_binSize = 17308;
+
+    extern const char*   wavetable_triangle_88200_bin;
+    const int            wavetable_triangle_88200_binSize = 33704;
+
+    extern const char*   wavetable_sawtooth_88200_bin;
+    const int            wavetable_sawtooth_88200_binSize = 33704;
+
+    extern const char*   wavetable_square_88200_bin;
+    const int            wavetable_square_88200_binSize = 33704;
+
+    extern const char*   wavetable_triangle_96000_bin;
+    const int            wavetable_triangle_96000_binSize = 33704;
+
+    extern const char*   wavetable_sawtooth_96000_bin;
+    const int            wavetable_sawtooth_96000_binSize = 33704;
+
+    extern const char*   wavetable_square_96000_bin;
+    const int            wavetable_square_96000_binSize = 33704;
+
+    extern const char*   wavetable_triangle_192000_bin;
+    const int            wavetable_triangle_192000_binSize = 66484;
+
+    extern const char*   wavetable_sawtooth_192000_bin;
+    const int            wavetable_sawtooth_192000_binSize = 66484;
+
+    extern const char*   wavetable_square_192000_bin;
+    const int            wavetable_square_192000_binSize = 66484;
+
     // Number of elements in the namedResourceList and originalFileNames arrays.
-    const int namedResourceListSize = 15;
+    const int namedResourceListSize = 30;
 
     // Points to the start of a list of resource names.
     extern const char* namedResourceList[];
@@ -0,0 +1,154 @@
+/*
+ ==============================================================================
+ sBMP4: killer subtractive synth!
+
+ Copyright (C) 2016  BMP4
+
+ Developer: Vincent Berthiaume
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#ifndef sBMP4_AdditiveOsc_h
+#define sBMP4_AdditiveOsc_h
+
+#include <cmath>
+#include "constants.h"
+
+//
+// AdditiveOsc
+//
+// sum of up to k_iMaxAdditivePartials harmonics with arbitrary amplitudes. Instead of calling sin() for each partial,
+// each one is a rotating phasor (cos, sin) that gets multiplied by its own fixed rotation every sample, so a sample
+// costs a few multiply-adds per partial. Partials are processed 4 at a time in SSE lanes.
+//
+// harmonics at or above nyquist are dropped every time the frequency changes, so any spectrum is band-limited.
+// Rounding makes the phasors drift slowly off the unit circle, so they are renormalized once per block.
+//
+class AdditiveOsc {
+public:
+    AdditiveOsc()
+        : m_dPhaseInc(0.0)
+        , m_iNumPartials(0)
+        , m_iNumActivePartials(0)
+    {
+        for (int idx = 0; idx < k_iMaxAdditivePartials; ++idx) {
+            m_afAmplitudes[idx] = m_afActiveAmplitudes[idx] = 0.f;
+            m_afRotationCos[idx] = 1.f;
+            m_afRotationSin[idx] = 0.f;
+        }
+        resetPhase();
+    }
+
+    // p_pfAmplitudes[k] is the amplitude of harmonic k + 1. Anything past k_iMaxAdditivePartials is ignored
+    void setPartials(const float* p_pfAmplitudes, const int p_iNumPartials) {
+        m_iNumPartials = jmin(p_iNumPartials, static_cast<int>(k_iMaxAdditivePartials));
+        for (int idx = 0; idx < k_iMaxAdditivePartials; ++idx) {
+            m_afAmplitudes[idx] = (idx < m_iNumPartials) ? p_pfAmplitudes[idx] : 0.f;
+        }
+        updateActivePartials();
+    }
+
+    // inc is in cycles per sample, ie frequency / sampleRate
+    void setFrequency(const double inc) {
+        m_dPhaseInc = inc;
+        for (int idx = 0; idx < k_iMaxAdditivePartials; ++idx) {
+            const double dOmega = 2.0 * double_Pi * (idx + 1) * inc;
+            m_afRotationCos[idx] = static_cast<float>(std::cos(dOmega));
+            m_afRotationSin[idx] = static_cast<float>(std::sin(dOmega));
+        }
+        updateActivePartials();
+    }
+
+    // all partials back to phase 0, ie sin(0)
+    void resetPhase() {
+        for (int idx = 0; idx < k_iMaxAdditivePartials; ++idx) {
+            m_afCos[idx] = 1.f;
+            m_afSin[idx] = 0.f;
+        }
+    }
+
+    // renders p_iNumSamples consecutive samples into p_pfDest
+    void renderBlock(float* p_pfDest, const int p_iNumSamples) {
+        const int iNumGroups = (m_iNumActivePartials + 3) / 4;
+
+        for (int iCurSample = 0; iCurSample < p_iNumSamples; ++iCurSample) {
+#if BMP4_USE_SSE
+            __m128 vSum = _mm_setzero_ps();
+            for (int iGroup = 0; iGroup < iNumGroups; ++iGroup) {
+                const int idx = 4 * iGroup;
+                const __m128 vCos = _mm_loadu_ps(m_afCos + idx);
+                const __m128 vSin = _mm_loadu_ps(m_afSin + idx);
+                const __m128 vRotCos = _mm_loadu_ps(m_afRotationCos + idx);
+                const __m128 vRotSin = _mm_loadu_ps(m_afRotationSin + idx);
+                vSum = _mm_add_ps(vSum, _mm_mul_ps(_mm_loadu_ps(m_afActiveAmplitudes + idx), vSin));
+                // (cos + i sin) * (rotCos + i rotSin)
+                _mm_storeu_ps(m_afCos + idx, _mm_sub_ps(_mm_mul_ps(vCos, vRotCos), _mm_mul_ps(vSin, vRotSin)));
+                _mm_storeu_ps(m_afSin + idx, _mm_add_ps(_mm_mul_ps(vSin, vRotCos), _mm_mul_ps(vCos, vRotSin)));
+            }
+            vSum = _mm_add_ps(vSum, _mm_movehl_ps(vSum, vSum));
+            vSum = _mm_add_ss(vSum, _mm_shuffle_ps(vSum, vSum, 1));
+            p_pfDest[iCurSample] = _mm_cvtss_f32(vSum);
+#else
+            float fSum = 0.f;
+            for (int idx = 0; idx < 4 * iNumGroups; ++idx) {
+                const float fCos = m_afCos[idx];
+                const float fSin = m_afSin[idx];
+                fSum += m_afActiveAmplitudes[idx] * fSin;
+                m_afCos[idx] = fCos * m_afRotationCos[idx] - fSin * m_afRotationSin[idx];
+                m_afSin[idx] = fSin * m_afRotationCos[idx] + fCos * m_afRotationSin[idx];
+            }
+            p_pfDest[iCurSample] = fSum;
+#endif
+        }
+
+        // first-order correction of the magnitude, good enough since it only drifts by a few ulps per block
+        for (int idx = 0; idx < 4 * iNumGroups; ++idx) {
+            const float fGain = 1.5f - 0.5f * (m_afCos[idx] * m_afCos[idx] + m_afSin[idx] * m_afSin[idx]);
+            m_afCos[idx] *= fGain;
+            m_afSin[idx] *= fGain;
+        }
+    }
+
+private:
+    // harmonic k + 1 is only played if it is below nyquist. Partials we don't play are still rotated if they
+    // share an SSE lane with one we do, but with a 0 amplitude
+    void updateActivePartials() {
+        m_iNumActivePartials = 0;
+        for (int idx = 0; idx < m_iNumPartials; ++idx) {
+            if ((idx + 1) * m_dPhaseInc < 0.5) {
+                m_iNumActivePartials = idx + 1;
+            }
+        }
+        for (int idx = 0; idx < k_iMaxAdditivePartials; ++idx) {
+            m_afActiveAmplitudes[idx] = (idx < m_iNumActivePartials) ? m_afAmplitudes[idx] : 0.f;
+        }
+    }
+
+    double m_dPhaseInc;
+    int m_iNumPartials;
+    int m_iNumActivePartials;
+
+    float m_afAmplitudes[k_iMaxAdditivePartials];
+    float m_afActiveAmplitudes[k_iMaxAdditivePartials];
+    // current phasor of each partial
+    float m_afCos[k_iMaxAdditivePartials];
+    float m_afSin[k_iMaxAdditivePartials];
+    // how much each phasor turns per sample
+    float m_afRotationCos[k_iMaxAdditivePartials];
+    float m_afRotationSin[k_iMaxAdditivePartials];
+};
+
+#endif  // sBMP4_AdditiveOsc_h
@@ -0,0 +1,219 @@
+/*
+ ==============================================================================
+ sBMP4: killer subtractive synth!
+
+ Copyright (C) 2016  BMP4
+
+ Developer: Vincent Berthiaume
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#ifndef sBMP4_AdsrEnvelope_h
+#define sBMP4_AdsrEnvelope_h
+
+#include <cmath>
+#include "constants.h"
+
+//
+// AdsrEnvelope
+//
+// amplitude envelope with exponential segments, the same curves as Nigel Redmon's EarLevel ADSR: each stage heads
+// for a target a bit past its end level, so the attack is slightly convex and decay and release really reach their
+// level in finite time instead of approaching it forever. Times are in seconds, so the shape doesn't depend on the
+// sample rate.
+//
+// the curve is evaluated exactly at the ends of segments of at most k_iVoiceBlockSize samples, and linearly in
+// between, so process() costs a pow() per segment plus a ramp and a vector multiply. Since the number of samples
+// left in a stage is known when entering it, process() knows exactly on which sample the release ends.
+//
+class AdsrEnvelope {
+public:
+    enum Stages {
+         stageIdle
+        ,stageAttack
+        ,stageDecay
+        ,stageSustain
+        ,stageRelease
+    };
+
+    AdsrEnvelope()
+        : m_dSampleRate(44100.)
+        , m_fAttack(k_fDefaultAttack)
+        , m_fDecay(k_fDefaultDecay)
+        , m_fSustain(k_fDefaultSustain)
+        , m_fRelease(k_fDefaultRelease)
+        , m_eStage(stageIdle)
+        , m_dLevel(0.)
+        , m_dTarget(0.)
+        , m_dCoef(0.)
+        , m_iSamplesLeft(0)
+    {
+    }
+
+    // takes effect on the next stage
+    void setSampleRate(const double p_dSampleRate) {
+        m_dSampleRate = p_dSampleRate;
+    }
+
+    // attack, decay and release in seconds, for a full-scale sweep. Sustain level in [0, 1]. Takes effect on the next stage
+    void setParameters(const float p_fAttack, const float p_fDecay, const float p_fSustain, const float p_fRelease) {
+        m_fAttack  = jmax(0.f, p_fAttack);
+        m_fDecay   = jmax(0.f, p_fDecay);
+        m_fSustain = jlimit(0.f, 1.f, p_fSustain);
+        m_fRelease = jmax(0.f, p_fRelease);
+    }
+
+    // starts the attack from the current level, so retriggering a voice that is still sounding doesn't click
+    void noteOn() {
+        enterStage(stageAttack);
+    }
+
+    void noteOff() {
+        if (m_eStage != stageIdle) {
+            enterStage(stageRelease);
+        }
+    }
+
+    // back to silence right away
+    void reset() {
+        m_eStage = stageIdle;
+        m_dLevel = 0.;
+    }
+
+    bool isActive() const       { return m_eStage != stageIdle; }
+    bool isSustaining() const   { return m_eStage == stageSustain; }
+    bool isReleasing() const    { return m_eStage == stageRelease; }
+    // level at the end of the last processed block
+    float getLevel() const      { return static_cast<float>(m_dLevel); }
+    float getSustain() const    { return m_fSustain; }
+
+    //
+    // process
+    //
+    // multiplies p_pfSamples by the envelope. Returns the number of samples before the envelope ended, ie
+    // p_iNumSamples unless the release finished in this block; the samples after that are cleared
+    //
+    int process(float* p_pfSamples, const int p_iNumSamples) {
+        int iCurSample = 0;
+        while (iCurSample < p_iNumSamples) {
+            const int iNumLeft = p_iNumSamples - iCurSample;
+            float* pfSamples = p_pfSamples + iCurSample;
+            if (m_eStage == stageIdle) {
+                FloatVectorOperations::clear(pfSamples, iNumLeft);
+                return iCurSample;
+            }
+            if (m_eStage == stageSustain) {
+                FloatVectorOperations::multiply(pfSamples, m_fSustain, iNumLeft);
+                return p_iNumSamples;
+            }
+
+            const int iNumSamples = jmin(jmin(iNumLeft, m_iSamplesLeft), k_iVoiceBlockSize);
+            m_iSamplesLeft -= iNumSamples;
+            const double dStartLevel = m_dLevel;
+            m_dLevel = (m_iSamplesLeft == 0) ? getEndLevel(m_eStage) : m_dTarget + (m_dLevel - m_dTarget) * std::pow(m_dCoef, iNumSamples);
+
+            // the last sample of the segment gets the level we computed for it
+            const float fStart = static_cast<float>(dStartLevel);
+            const float fStep = static_cast<float>((m_dLevel - dStartLevel) / iNumSamples);
+            for (int idx = 0; idx < iNumSamples; ++idx) {
+                m_afRamp[idx] = fStart + fStep * (idx + 1);
+            }
+            FloatVectorOperations::multiply(pfSamples, m_afRamp, iNumSamples);
+
+            iCurSample += iNumSamples;
+            if (m_iSamplesLeft == 0) {
+                enterStage(getNextStage(m_eStage));
+            }
+        }
+        return p_iNumSamples;
+    }
+
+private:
+    // same ratios as the EarLevel ADSR: how far past its end level each stage aims, relative to its range
+    static double getTargetRatio(const Stages p_eStage) {
+        return p_eStage == stageAttack ? 0.3 : 0.0001;
+    }
+
+    double getEndLevel(const Stages p_eStage) const {
+        switch (p_eStage) {
+            case stageAttack:   return 1.;
+            case stageDecay:
+            case stageSustain:  return m_fSustain;
+            default:            return 0.;
+        }
+    }
+
+    Stages getNextStage(const Stages p_eStage) const {
+        switch (p_eStage) {
+            case stageAttack:   return stageDecay;
+            // a sustain at 0 is silence, so we might as well free the voice
+            case stageDecay:    return m_fSustain > 0.f ? stageSustain : stageIdle;
+            default:            return stageIdle;
+        }
+    }
+
+    //
+    // enterStage
+    //
+    // the level follows target + (level - target) * coef^n. For a stage of t seconds, coef is such that the whole
+    // range (eg 1 to sustain) takes t seconds, and from there we know how many samples it takes from the current level
+    //
+    void enterStage(const Stages p_eStage) {
+        m_eStage = p_eStage;
+        if (p_eStage == stageIdle) {
+            m_dLevel = 0.;
+            return;
+        }
+        if (p_eStage == stageSustain) {
+            m_dLevel = m_fSustain;
+            return;
+        }
+
+        // the range the stage time is defined for: 0 to 1 for the attack, 1 down to the end level for the others
+        const double dStageStart = (p_eStage == stageAttack) ? 0. : 1.;
+        const double dEnd = getEndLevel(p_eStage);
+        const double dSeconds = (p_eStage == stageAttack) ? m_fAttack : (p_eStage == stageDecay ? m_fDecay : m_fRelease);
+        const double dRatio = getTargetRatio(p_eStage);
+        const double dNumSamples = dSeconds * m_dSampleRate;
+
+        // already there, or no time to get there
+        if (m_dLevel == dEnd || dNumSamples < 1.) {
+            m_dLevel = dEnd;
+            enterStage(getNextStage(p_eStage));
+            return;
+        }
+
+        m_dTarget = dEnd + dRatio * (dEnd - dStageStart);
+        m_dCoef = std::exp(-std::log((1. + dRatio) / dRatio) / dNumSamples);
+        // the release can start above sustain, and the attack above 0, so count from where we actually are
+        const double dDistance = (dEnd - m_dTarget) / (m_dLevel - m_dTarget);
+        m_iSamplesLeft = (dDistance > 0. && dDistance < 1.) ? jmax(1, static_cast<int>(std::ceil(std::log(dDistance) / std::log(m_dCoef)))) : 1;
+    }
+
+    double m_dSampleRate;
+    float m_fAttack, m_fDecay, m_fSustain, m_fRelease;
+
+    Stages m_eStage;
+    double m_dLevel;
+    // the current stage heads for m_dTarget, multiplying its distance to it by m_dCoef every sample
+    double m_dTarget;
+    double m_dCoef;
+    int m_iSamplesLeft;
+
+    float m_afRamp[k_iVoiceBlockSize];
+};
+
+#endif  // sBMP4_AdsrEnvelope_h
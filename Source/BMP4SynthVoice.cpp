@@ -25,173 +25,420 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define _USE_MATH_DEFINES
 #include <math.h>
 
-Bmp4SynthVoice::Bmp4SynthVoice()
+Bmp4SynthVoice::Bmp4SynthVoice(const WaveTableBankLoader& p_oWaveTables)
 	: m_dOmega(0.0)
-	, m_dTailOff(0.0)
-    , m_iCurSound(soundSine)
-	, m_oWaveTableTriangle(getSampleRate(), triangleWave)
-	, m_oWaveTableSawtooth(getSampleRate(), sawtoothWave)
-	, m_oWaveTableSquare(  getSampleRate(), squareWave)
-{ }
+	, m_dLevel(0.0)
+	, m_fOscGain(1.f)
+	, m_fSubOscGain(1.f)
+	, m_eCurWaveType(sineWave)
+	, m_oWaveTables(p_oWaveTables)
+	, m_pCurWaveTableOsc(nullptr)
+	, m_bSubOscOn(false)
+	, m_bSubOscPlaying(false)
+	, m_eSubOscWaveType(k_eDefaultSubOscWave)
+	, m_fSubOscLevel(k_fDefaultSubOscLevel)
+	, m_vScratch(k_iVoiceBlockSize)
+	, m_fFadeGain(0.f)
+	, m_fFadeSubGain(0.f)
+	, m_iFadeSamplesLeft(0)
+	, m_iFadeLength(0)
+	, m_bStealPending(false)
+	, m_vFadeScratch(k_iVoiceBlockSize)
+	, m_pSynth(nullptr)
+	, m_iPoolIndex(-1)
+{
+	setInterpolationMode(k_eDefaultInterpolationMode);
+}
+
+void Bmp4SynthVoice::prepareToPlay(const int p_iMaxBlockSize) {
+	m_vScratch.resize(jmax(p_iMaxBlockSize, k_iVoiceBlockSize));
+	m_vFadeScratch.resize(m_vScratch.size());
+}
+
+void Bmp4SynthVoice::setInterpolationMode(const InterpolationModes p_eMode) {
+	for (int iCurWave = 0; iCurWave < totalWaveTypes; ++iCurWave) {
+		m_aWaveTableOscs[iCurWave].setInterpolationMode(p_eMode);
+	}
+	m_oSubOsc.setInterpolationMode(p_eMode);
+}
+
+void Bmp4SynthVoice::setSubOscillator(const bool p_bOn, const WaveTypes p_eWaveType, const float p_fLevel) {
+	m_bSubOscOn = p_bOn;
+	m_eSubOscWaveType = p_eWaveType;
+	m_fSubOscLevel = p_fLevel;
+}
 
 void Bmp4SynthVoice::startNote(int midiNoteNumber, float velocity, SynthesiserSound* sound, int /*currentPitchWheelPosition*/)  {
-    m_dCurrentAngle = 0.0;
     m_dLevel = velocity * 0.15;
-    m_dTailOff = 0.0;
     double dFrequency = MidiMessage::getMidiNoteInHertz(midiNoteNumber);
     double dNormalizedFreq = dFrequency / getSampleRate();
     
 	m_dOmega = dNormalizedFreq * 2.0 * double_Pi;
 
-    if(dynamic_cast <SineWaveSound*> (getCurrentlyPlayingSound().get())){
-        m_iCurSound = soundSine;
-		JUCE_COMPILER_WARNING("using triangle since no sine yet")
-		if(k_bUseWaveTables){
-			m_oWaveTableTriangle.setFrequency(dNormalizedFreq);
+	//canPlaySound already checked that this is one of ours
+	jassert(dynamic_cast<Bmp4Sound*>(sound) != nullptr);
+	m_eCurWaveType = static_cast<Bmp4Sound*>(sound)->getWaveType();
+
+	if(k_bUseWaveTables){
+		m_pCurWaveTableOsc = &m_aWaveTableOscs[m_eCurWaveType];
+		m_pCurWaveTableOsc->setBank(m_oWaveTables.getBank(m_eCurWaveType));
+		m_pCurWaveTableOsc->setFrequency(dNormalizedFreq);
+		m_fOscGain = getOscGain(m_eCurWaveType);
+	} else {
+		setAdditivePartials(m_oAdditiveOsc, m_eCurWaveType);
+		m_oAdditiveOsc.resetPhase();
+		m_oAdditiveOsc.setFrequency(dNormalizedFreq);
+	}
+
+	m_bSubOscPlaying = m_bSubOscOn;
+	if (m_bSubOscPlaying) {
+		const WaveTypes eSubOscWave = (m_eSubOscWaveType == k_eSubOscFollowsNote) ? m_eCurWaveType : m_eSubOscWaveType;
+		if (k_bUseWaveTables) {
+			m_oSubOsc.setBank(m_oWaveTables.getBank(eSubOscWave));
+			m_oSubOsc.setFrequency(dNormalizedFreq * .5);
+			m_fSubOscGain = getOscGain(eSubOscWave);
+		} else {
+			setAdditivePartials(m_oAdditiveSubOsc, eSubOscWave);
+			m_oAdditiveSubOsc.resetPhase();
+			m_oAdditiveSubOsc.setFrequency(dNormalizedFreq * .5);
+		}
+	}
+
+	m_bStealPending = false;
+	m_oEnvelope.setSampleRate(getSampleRate());
+	m_oEnvelope.noteOn();
+	if (m_pSynth != nullptr) {
+		m_pSynth->voiceStarted(this);
+	}
+}
+
+//the sine keeps the velocity sensitive level it had as additive synthesis, the tables of the other waves are loud enough
+float Bmp4SynthVoice::getOscGain(const WaveTypes p_eWaveType) const {
+	return (p_eWaveType == sineWave) ? static_cast<float>(m_dLevel * .9 / k_fWaveTableGain) : 1.f;
+}
+
+void Bmp4SynthVoice::startStealFade() {
+	if (m_pCurWaveTableOsc == nullptr || m_dOmega == 0.0) {
+		return;
+	}
+	const float fLevel = m_oEnvelope.getLevel();
+	m_oFadeOsc = *m_pCurWaveTableOsc;
+	m_fFadeGain = fLevel * m_fOscGain;
+	m_oFadeSubOsc = m_oSubOsc;
+	m_fFadeSubGain = m_bSubOscPlaying ? fLevel * m_fSubOscGain * m_fSubOscLevel : 0.f;
+	m_iFadeLength = m_iFadeSamplesLeft = jmax(1, roundToInt(k_fStealFadeTime * getSampleRate()));
+	m_bStealPending = true;
+}
+
+//adds the next p_iNumSamples samples of the fading note to p_pfDest, on a linear ramp down to 0
+void Bmp4SynthVoice::addStealFade(float* p_pfDest, const int p_iNumSamples) {
+	const int iNumSamples = jmin(p_iNumSamples, m_iFadeSamplesLeft, static_cast<int>(m_vFadeScratch.size()));
+	float* pfFade = m_vFadeScratch.data();
+	m_oFadeOsc.renderBlock(pfFade, iNumSamples);
+	if (m_fFadeGain != 1.f) {
+		FloatVectorOperations::multiply(pfFade, m_fFadeGain, iNumSamples);
+	}
+	if (m_fFadeSubGain != 0.f) {
+		m_oFadeSubOsc.addBlock(pfFade, iNumSamples, m_fFadeSubGain);
+	}
+	const float fStep = 1.f / m_iFadeLength;
+	for (int idx = 0; idx < iNumSamples; ++idx) {
+		p_pfDest[idx] += pfFade[idx] * fStep * (m_iFadeSamplesLeft - idx - 1);
+	}
+	m_iFadeSamplesLeft -= iNumSamples;
+}
+
+void Bmp4SynthVoice::finishNote() {
+	//a hard stop silences everything, but when we're being stolen the old note still has to fade
+	if (!m_bStealPending) {
+		m_iFadeSamplesLeft = 0;
+	}
+	m_oEnvelope.reset();
+	clearCurrentNote();
+	m_dOmega = 0.0;
+	if (m_pSynth != nullptr) {
+		m_pSynth->voiceFinished(this);
+	}
+}
+void Bmp4SynthVoice::renderNextBlock(AudioSampleBuffer& p_oOutputBuffer, int p_iStartSample, int p_iTotalSamples)  {
+	if (m_dOmega == 0.0) {
+		return;
+	}
+	WaveTableOsc* pOsc = m_pCurWaveTableOsc;
+
+	//render the oscillator into our mono scratch block, apply the envelope, then add that to each channel in one go.
+	//The scratch block is sized in prepareToPlay, so we only loop if the host sends more than it announced
+	float* pfScratch = m_vScratch.data();
+	while (p_iTotalSamples > 0) {
+		int iNumSamples = jmin(p_iTotalSamples, static_cast<int>(m_vScratch.size()));
+		if (pOsc != nullptr) {
+			pOsc->renderBlock(pfScratch, iNumSamples);
+			if (m_fOscGain != 1.f) {
+				FloatVectorOperations::multiply(pfScratch, m_fOscGain, iNumSamples);
+			}
+			if (m_bSubOscPlaying) {
+				m_oSubOsc.addBlock(pfScratch, iNumSamples, m_fSubOscGain * m_fSubOscLevel);
+			}
+		} else {
+			m_oAdditiveOsc.renderBlock(pfScratch, iNumSamples);
+			if (m_bSubOscPlaying) {
+				//the steal fade is wavetable only, so its scratch block is free here
+				float* pfSub = m_vFadeScratch.data();
+				m_oAdditiveSubOsc.renderBlock(pfSub, iNumSamples);
+				FloatVectorOperations::addWithMultiply(pfScratch, pfSub, m_fSubOscLevel, iNumSamples);
+			}
 		}
-    } else if(dynamic_cast <SquareWaveSound*> (getCurrentlyPlayingSound().get())){
-        m_iCurSound = soundSquare;
-		if(k_bUseWaveTables){
-			m_oWaveTableSquare.setFrequency(dNormalizedFreq);
+
+		iNumSamples = m_oEnvelope.process(pfScratch, iNumSamples);
+		const bool bNoteEnded = !m_oEnvelope.isActive();
+		if (m_iFadeSamplesLeft > 0) {
+			addStealFade(pfScratch, iNumSamples);
 		}
-    } else if(dynamic_cast <TriangleWaveSound*> (getCurrentlyPlayingSound().get())){
-        m_iCurSound = soundTriangle;
-		if(k_bUseWaveTables){
-			m_oWaveTableTriangle.setFrequency(dNormalizedFreq);
+
+		for (int iChannel = 0; iChannel < p_oOutputBuffer.getNumChannels(); ++iChannel) {
+			FloatVectorOperations::add(p_oOutputBuffer.getWritePointer(iChannel, p_iStartSample), pfScratch, iNumSamples);
 		}
-    } else if(dynamic_cast <SawtoothWaveSound*> (getCurrentlyPlayingSound().get())){
-        m_iCurSound = soundSawtooth;
-		if(k_bUseWaveTables){
-			m_oWaveTableSawtooth.setFrequency(dNormalizedFreq);
+		if (bNoteEnded) {
+			finishNote();
+			return;
 		}
-    }
+		p_iStartSample += iNumSamples;
+		p_iTotalSamples -= iNumSamples;
+	}
 }
-void Bmp4SynthVoice::renderNextBlock(AudioSampleBuffer& p_oOutputBuffer, int p_iStartSample, int p_iTotalSamples)  {
+
+bool Bmp4SynthVoice::addToMixer(WaveTableMixer& p_oMixer, const int p_iNumSamples) {
 	if (m_dOmega == 0.0) {
+		return true;	//nothing to render
+	}
+	WaveTableOsc* pOsc = m_pCurWaveTableOsc;
+	if (pOsc == nullptr) {
+		return false;
+	}
+	//the mixer only has a fixed gain per oscillator, so only sustained notes can go there. Note offs come between
+	//blocks, so we're sure to stay in sustain for the whole block
+	if (!m_oEnvelope.isSustaining() || m_iFadeSamplesLeft > 0) {
+		return false;
+	}
+	const float fSustain = m_oEnvelope.getSustain();
+	if (m_bSubOscPlaying) {
+		return p_oMixer.add(*pOsc, fSustain * m_fOscGain, m_oSubOsc, fSustain * m_fSubOscGain * m_fSubOscLevel);
+	}
+	return p_oMixer.add(*pOsc, fSustain * m_fOscGain);
+}
+
+Bmp4Synthesiser::Bmp4Synthesiser()
+	: m_vMix(k_iVoiceBlockSize)
+	, m_iNumBusyVoices(0)
+	, m_iPolyphony(k_iNumberOfVoices)
+	, m_eStealingMode(k_eDefaultVoiceStealingMode)
+	, m_iSelectedSound(0)
+{
+}
+
+void Bmp4Synthesiser::addBmp4Voices(const WaveTableBankLoader& p_oWaveTables, const int p_iNumVoices) {
+	m_oVoicePool.ensureStorageAllocated(m_oVoicePool.size() + p_iNumVoices);
+	for (int iCurVox = 0; iCurVox < p_iNumVoices; ++iCurVox) {
+		Bmp4SynthVoice* pVoice = new Bmp4SynthVoice(p_oWaveTables);
+		pVoice->m_pSynth = this;
+		pVoice->m_iPoolIndex = m_oVoicePool.size();
+		m_oVoicePool.add(pVoice);
+		addVoice(pVoice);
+	}
+	setPolyphony(m_iPolyphony);
+}
+
+void Bmp4Synthesiser::setSubOscillator(const bool p_bOn, const WaveTypes p_eWaveType, const float p_fLevel) {
+	const ScopedLock oLock(lock);
+	for (int iCurVox = 0; iCurVox < m_oVoicePool.size(); ++iCurVox) {
+		m_oVoicePool.getUnchecked(iCurVox)->setSubOscillator(p_bOn, p_eWaveType, p_fLevel);
+	}
+}
+
+void Bmp4Synthesiser::noteOn(int p_iMidiChannel, int p_iMidiNoteNumber, float p_fVelocity) {
+	const ScopedLock oLock(lock);
+	SynthesiserSound* pSound = sounds.getObjectPointer(getSelectedSound());
+	if (pSound == nullptr || !pSound->appliesToNote(p_iMidiNoteNumber) || !pSound->appliesToChannel(p_iMidiChannel)) {
 		return;
 	}
-	//render all p_iTotalSamples
-	for (int iCurSample = 0; iCurSample < p_iTotalSamples; ++iCurSample) {
-		//this will be == 1 if we don't have a tail off or = m_dTailOff if we do
-		double dTailOffCopy = (m_dTailOff > 0) ? m_dTailOff : 1;
+	//if the note is still ringing, eg because of the sustain pedal, stop it first
+	for (int iCurVox = voices.size(); --iCurVox >= 0;) {
+		SynthesiserVoice* pVoice = voices.getUnchecked(iCurVox);
+		if (pVoice->getCurrentlyPlayingNote() == p_iMidiNoteNumber && pVoice->isPlayingChannel(p_iMidiChannel)) {
+			stopVoice(pVoice, 1.f, true);
+		}
+	}
+	SynthesiserVoice* pVoice = findFreeVoice(pSound, p_iMidiChannel, p_iMidiNoteNumber, isNoteStealingEnabled());
+	//a voice that is still playing is being stolen
+	Bmp4SynthVoice* pBmp4Voice = dynamic_cast<Bmp4SynthVoice*>(pVoice);
+	if (pBmp4Voice != nullptr && pBmp4Voice->isVoiceActive()) {
+		pBmp4Voice->startStealFade();
+	}
+	startVoice(pVoice, pSound, p_iMidiChannel, p_iMidiNoteNumber, p_fVelocity);
+}
+
+void Bmp4Synthesiser::setPolyphony(const int p_iPolyphony) {
+	const ScopedLock oLock(lock);
+	m_iPolyphony = jmax(1, jmin(p_iPolyphony, m_oVoicePool.size()));
+}
+
+void Bmp4Synthesiser::swapPoolVoices(const int p_iIndex1, const int p_iIndex2) {
+	m_oVoicePool.swap(p_iIndex1, p_iIndex2);
+	m_oVoicePool.getUnchecked(p_iIndex1)->m_iPoolIndex = p_iIndex1;
+	m_oVoicePool.getUnchecked(p_iIndex2)->m_iPoolIndex = p_iIndex2;
+}
+
+//moves p_pVoice at the end of the busy part of the pool, unless it already is in it, eg when it was stolen
+void Bmp4Synthesiser::voiceStarted(Bmp4SynthVoice* p_pVoice) {
+	if (p_pVoice->m_iPoolIndex >= m_iNumBusyVoices) {
+		swapPoolVoices(p_pVoice->m_iPoolIndex, m_iNumBusyVoices);
+		++m_iNumBusyVoices;
+	}
+}
+
+//moves p_pVoice at the start of the free part of the pool
+void Bmp4Synthesiser::voiceFinished(Bmp4SynthVoice* p_pVoice) {
+	if (p_pVoice->m_iPoolIndex < m_iNumBusyVoices) {
+		--m_iNumBusyVoices;
+		swapPoolVoices(p_pVoice->m_iPoolIndex, m_iNumBusyVoices);
+	}
+}
 
-		//this is a virtual call to child functions. Not sure at this point why we need a copy of the tailOff, but not doing that doesn't work
-		const float fCurrentSample = getSample(dTailOffCopy);
+SynthesiserVoice* Bmp4Synthesiser::findFreeVoice(SynthesiserSound* p_pSound, int p_iMidiChannel, int p_iMidiNoteNumber, bool p_bStealIfNoneAvailable) const {
+	//anything else, eg sampled sounds, goes through the usual scan
+	if (dynamic_cast<Bmp4Sound*>(p_pSound) == nullptr) {
+		return Synthesiser::findFreeVoice(p_pSound, p_iMidiChannel, p_iMidiNoteNumber, p_bStealIfNoneAvailable);
+	}
+	if (m_iNumBusyVoices < m_iPolyphony) {
+		return m_oVoicePool.getUnchecked(m_iNumBusyVoices);
+	}
+	return p_bStealIfNoneAvailable ? findVoiceToSteal(p_pSound, p_iMidiChannel, p_iMidiNoteNumber) : nullptr;
+}
 
-        for(int i = 0; i < p_oOutputBuffer.getNumChannels(); ++i){
-			p_oOutputBuffer.addSample(i, p_iStartSample, fCurrentSample);
+//
+// findVoiceToSteal
+//
+// voices that are already released are taken before the ones that are still held. Among those, we take the oldest
+// or the quietest, depending on m_eStealingMode. In stealSameNote, a voice playing the same note wins right away
+//
+SynthesiserVoice* Bmp4Synthesiser::findVoiceToSteal(SynthesiserSound* p_pSound, int p_iMidiChannel, int p_iMidiNoteNumber) const {
+	if (dynamic_cast<Bmp4Sound*>(p_pSound) == nullptr) {
+		return Synthesiser::findVoiceToSteal(p_pSound, p_iMidiChannel, p_iMidiNoteNumber);
+	}
+	Bmp4SynthVoice* pBest = nullptr;
+	bool bBestIsReleasing = false;
+	for (int iCurVox = 0; iCurVox < m_iNumBusyVoices; ++iCurVox) {
+		Bmp4SynthVoice* pVoice = m_oVoicePool.getUnchecked(iCurVox);
+		if (m_eStealingMode == stealSameNote && pVoice->getCurrentlyPlayingNote() == p_iMidiNoteNumber && pVoice->isPlayingChannel(p_iMidiChannel)) {
+			return pVoice;
 		}
-		m_dCurrentAngle += m_dOmega;	//m_dOmega here is in radian (as it always is!)
-
-		if (k_bUseWaveTables){
-			//increase the phase by phaseInc
-			switch(m_iCurSound){
-				case soundSine:
-				case soundTriangle:
-					m_oWaveTableTriangle.updatePhase();
-					break;
-				case soundSawtooth:
-					m_oWaveTableSawtooth.updatePhase();
-					break;
-				case soundSquare:
-					m_oWaveTableSquare.updatePhase();
-					break;
-				default:
-					jassertfalse;
-					break;
-			}
+		const bool bIsReleasing = pVoice->isReleasing();
+		bool bIsBetter;
+		if (pBest == nullptr || bIsReleasing != bBestIsReleasing) {
+			bIsBetter = (pBest == nullptr || bIsReleasing);
+		} else if (m_eStealingMode == stealQuietest) {
+			bIsBetter = pVoice->getEnvelopeLevel() < pBest->getEnvelopeLevel();
+		} else {
+			bIsBetter = pVoice->wasStartedBefore(*pBest);
 		}
-		++p_iStartSample;
-		if (m_dTailOff > 0) {
-			m_dTailOff *= 0.99;
-			if (m_dTailOff <= 0.005) {
-				clearCurrentNote();
-				m_dOmega = 0.0;
-				break;
-			}
+		if (bIsBetter) {
+			pBest = pVoice;
+			bBestIsReleasing = bIsReleasing;
+		}
+	}
+	return pBest;
+}
+
+void Bmp4Synthesiser::prepareToPlay(const double p_dSampleRate, const int p_iMaxBlockSize) {
+	setCurrentPlaybackSampleRate(p_dSampleRate);
+	m_vMix.resize(jmax(p_iMaxBlockSize, k_iVoiceBlockSize));
+	for (int iCurVox = 0; iCurVox < voices.size(); ++iCurVox) {
+		if (Bmp4SynthVoice* pVoice = dynamic_cast<Bmp4SynthVoice*>(voices.getUnchecked(iCurVox))) {
+			pVoice->prepareToPlay(p_iMaxBlockSize);
 		}
 	}
 }
 
-float Bmp4SynthVoice::getSample(double dTail) {
-    if(k_bUseWaveTables){
-		JUCE_COMPILER_WARNING("this is not using the tail")
-		switch(m_iCurSound){
-			case soundSine:
-				return getSampleAdditiveSynthesis(dTail) * .9;
-			case soundTriangle:
-				return m_oWaveTableTriangle.getOutput();
-			case soundSawtooth:
-				return m_oWaveTableSawtooth.getOutput();
-			case soundSquare:
-				return m_oWaveTableSquare.getOutput();
-			default:
-				jassertfalse;
-				break;
+void Bmp4Synthesiser::renderVoices(AudioSampleBuffer& p_oOutputBuffer, int p_iStartSample, int p_iNumSamples) {
+	m_oMixer.clear();
+	for (int iCurVoice = voices.size(); --iCurVoice >= 0;) {
+		SynthesiserVoice* pVoice = voices.getUnchecked(iCurVoice);
+		Bmp4SynthVoice* pBmp4Voice = dynamic_cast<Bmp4SynthVoice*>(pVoice);
+		if (pBmp4Voice == nullptr || !pBmp4Voice->addToMixer(m_oMixer, p_iNumSamples)) {
+			pVoice->renderNextBlock(p_oOutputBuffer, p_iStartSample, p_iNumSamples);
+		}
+	}
+	if (m_oMixer.isEmpty()) {
+		return;
+	}
+
+	//the mix is mono, so render it once and add it to every channel
+	const int iMaxSamples = static_cast<int>(m_vMix.size());
+	for (int iStart = 0; iStart < p_iNumSamples; iStart += iMaxSamples) {
+		const int iNumSamples = jmin(iMaxSamples, p_iNumSamples - iStart);
+		FloatVectorOperations::clear(m_vMix.data(), iNumSamples);
+		m_oMixer.render(m_vMix.data(), iNumSamples);
+		for (int iChannel = 0; iChannel < p_oOutputBuffer.getNumChannels(); ++iChannel) {
+			FloatVectorOperations::add(p_oOutputBuffer.getWritePointer(iChannel, p_iStartSample + iStart), m_vMix.data(), iNumSamples);
 		}
-    } else {
-		return getSampleAdditiveSynthesis(dTail);
-    }
+	}
 }
 
-float Bmp4SynthVoice::getSampleAdditiveSynthesis(double dTail){
-	switch(m_iCurSound){
-		case soundSine:
+//amplitudes of the same series the voice used to sum with sin(), scaled by the note level
+void Bmp4SynthVoice::setAdditivePartials(AdditiveOsc& p_oOsc, const WaveTypes p_eWaveType) {
+	float afAmplitudes[k_iMaxAdditivePartials] = {};
+	int iNumPartials = 0;
+	switch(p_eWaveType){
+		case sineWave:
 		default:
-			return (float)(sin(m_dCurrentAngle) * m_dLevel * dTail);
+			afAmplitudes[0] = 1.f;
+			iNumPartials = 1;
 			break;
-		case soundSquare:{
-			double dCurrentSample = 0.0;
+		case squareWave:{
+			const float fReducingFactor = .75f; //this is to make this wave appear as loud at the other ones
 			for(int iCurK = 0; iCurK < 25; ++iCurK){
-				dCurrentSample += sin(m_dCurrentAngle * (2 * iCurK + 1)) / (2 * iCurK + 1);
+				afAmplitudes[2 * iCurK] = fReducingFactor / (2 * iCurK + 1);
 			}
-			double dReducingFactor = .75; //this is to make this wave appear as loud at the other ones
-			return static_cast<float> (dCurrentSample * m_dLevel * dTail * dReducingFactor);
+			iNumPartials = 49;
 			break;
 		}
-		case soundTriangle:{
-			float fCurrentSample = 0.0;
+		case triangleWave:{
 			for(int iCurK = 0; iCurK < 5; ++iCurK){
-				fCurrentSample += static_cast<float> (sin(M_PI*(2 * iCurK + 1) / 2) * (sin(m_dCurrentAngle * (2 * iCurK + 1)) / pow((2 * iCurK + 1), 2)));
+				const float fSign = (iCurK & 1) ? -1.f : 1.f;	//sin(pi * (2k+1) / 2)
+				afAmplitudes[2 * iCurK] = static_cast<float>(8 / pow(M_PI, 2)) * fSign / ((2 * iCurK + 1) * (2 * iCurK + 1));
 			}
-			return (8 / pow(M_PI, 2)) * fCurrentSample * m_dLevel * dTail;
+			iNumPartials = 9;
 			break;
 		}
-		case soundSawtooth:{
-			float fCurrentSample = 0.0;
+		case sawtoothWave:{
 			for(int iCurK = 1; iCurK < 20; ++iCurK){
-				fCurrentSample += static_cast<float> (sin(m_dCurrentAngle * iCurK) / iCurK);
+				afAmplitudes[iCurK - 1] = static_cast<float>(-1 / (M_PI * iCurK));
 			}
-			return 1 / 2 - (1 / M_PI) * fCurrentSample * m_dLevel * dTail;
+			iNumPartials = 19;
 			break;
 		}
 	}
+	for (int idx = 0; idx < iNumPartials; ++idx) {
+		afAmplitudes[idx] *= static_cast<float>(m_dLevel);
+	}
+	p_oOsc.setPartials(afAmplitudes, iNumPartials);
 }
+
 void Bmp4SynthVoice::stopNote(float /*velocity*/, bool allowTailOff)  {
 
 	if (allowTailOff) {
-		// start a tail-off by setting this flag. The render callback will pick up on this and do a fade out, calling clearCurrentNote() when it's finished.
-		if (m_dTailOff == 0.0)	// we only need to begin a tail-off if it's not already doing so - the stopNote method could be called more than once.
-			m_dTailOff = 1.0;
+		// start the release. The render callback calls clearCurrentNote() on the sample where it ends
+		m_oEnvelope.noteOff();
 	} else {
 		// we're being told to stop playing immediately, so reset everything..
-		clearCurrentNote();
-		m_dOmega = 0.0;
+		finishNote();
 	}
 }
 bool Bmp4SynthVoice::canPlaySound(SynthesiserSound* sound)  {
 
-	if (dynamic_cast <SineWaveSound*> (sound) ||
-        dynamic_cast <SquareWaveSound*> (sound) ||
-        dynamic_cast <TriangleWaveSound*> (sound) ||
-        dynamic_cast <SawtoothWaveSound*> (sound)){
-		return true;
-	} else {
-		return false;
-	}
+	return dynamic_cast<Bmp4Sound*>(sound) != nullptr;
 }
 
-JUCE_COMPILER_WARNING("Would probably be way more efficient to use wave tables for all these additive synthesis getSamples in square, triangle and sawtooth")
 
 
 
@@ -26,70 +26,44 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "constants.h"
-#include "PluginProcessor.h"
 #include "WaveTableOsc.h"
+#include "AdditiveOsc.h"
+#include "AdsrEnvelope.h"
+#include <vector>
+#include <atomic>
 
 //==============================================================================
 //Synth sounds
 
-JUCE_COMPILER_WARNING("this should be the same as the wavetypes enum")
-enum sounds{
-     soundSine
-    ,soundSquare
-    ,soundTriangle
-    ,soundSawtooth
-    ,soundTotalCount
-};
-
-class SineWaveSound : public SynthesiserSound
+//one sound for all our waveforms, tagged with its wave type. It is final so that the dynamic_cast in canPlaySound,
+//which runs for every voice on every note on, compiles down to a single vtable comparison
+class Bmp4Sound final : public SynthesiserSound
 {
 public:
-	SineWaveSound() {}
-
-	bool appliesToNote(int /*midiNoteNumber*/) override  { return true; }
-	bool appliesToChannel(int /*midiChannel*/) override  { return true; }
-};
+	explicit Bmp4Sound(const WaveTypes p_eWaveType) : m_eWaveType(p_eWaveType) {}
 
-class SquareWaveSound : public SynthesiserSound
-{
-public:
-	SquareWaveSound() {}
+	WaveTypes getWaveType() const { return m_eWaveType; }
 
 	bool appliesToNote(int /*midiNoteNumber*/) override  { return true; }
 	bool appliesToChannel(int /*midiChannel*/) override  { return true; }
-};
-
-class TriangleWaveSound : public SynthesiserSound
-{
-public:
-	TriangleWaveSound() {}
 
-	bool appliesToNote(int /*midiNoteNumber*/) override  { return true; }
-	bool appliesToChannel(int /*midiChannel*/) override  { return true; }
+private:
+	const WaveTypes m_eWaveType;
 };
 
-class SawtoothWaveSound : public SynthesiserSound
-{
-public:
-	SawtoothWaveSound() {}
-
-	bool appliesToNote(int /*midiNoteNumber*/) override  { return true; }
-	bool appliesToChannel(int /*midiChannel*/) override  { return true; }
-};
 
+class Bmp4Synthesiser;
 
 class Bmp4SynthVoice : public SynthesiserVoice
 {
+	friend class Bmp4Synthesiser;
+
 public:
-	Bmp4SynthVoice();
+	Bmp4SynthVoice(const WaveTableBankLoader& p_oWaveTables);
 
 	// this is where we determine which unique sound this voice can play
     bool canPlaySound(SynthesiserSound* sound);
 
-    virtual float getSample(double dTail);
-	
-	float getSampleAdditiveSynthesis(double dTail);
-
 	void renderNextBlock(AudioSampleBuffer& p_oOutputBuffer, int p_iStartSample, int p_iTotalSamples) override;
 
 	void startNote(int midiNoteNumber, float velocity, SynthesiserSound* sound, int /*currentPitchWheelPosition*/) override;
@@ -104,12 +78,138 @@ public:
 		// not interested in controllers in this case.
 	}
 
+	//applies to all wavetable oscillators, takes effect on the next rendered block
+	void setInterpolationMode(const InterpolationModes p_eMode);
+
+	//sub oscillator one octave below the note, through the same envelope. p_eWaveType can be k_eSubOscFollowsNote
+	//for the note's own wave. Takes effect on the next note, except for the level. Sampled sounds are played by
+	//SamplerVoices, which have no sub
+	void setSubOscillator(const bool p_bOn, const WaveTypes p_eWaveType, const float p_fLevel);
+
+	//sizes the scratch block for host blocks of up to p_iMaxBlockSize samples, so that rendering never allocates
+	void prepareToPlay(const int p_iMaxBlockSize);
+
+	//hands our next p_iNumSamples samples to p_oMixer instead of rendering them in renderNextBlock. Returns false if
+	//we need to render ourselves: no wavetable, full mixer, or an envelope that isn't sustaining
+	bool addToMixer(WaveTableMixer& p_oMixer, const int p_iNumSamples);
+
+	//for voice stealing
+	bool isReleasing() const { return m_oEnvelope.isReleasing(); }
+	float getEnvelopeLevel() const { return m_oEnvelope.getLevel(); }
+	//called right before the voice is stolen: the current note keeps playing in the background and fades out over
+	//k_fStealFadeTime, instead of being cut when the new one starts. Only for wavetable voices
+	void startStealFade();
+
+protected:
+	//sets p_oOsc up for p_eWaveType at the level of the current note
+	void setAdditivePartials(AdditiveOsc& p_oOsc, const WaveTypes p_eWaveType);
+	//stops right away and tells our synth we're free
+	void finishNote();
+	//m_fOscGain for p_eWaveType, given the level of the current note
+	float getOscGain(const WaveTypes p_eWaveType) const;
+
+	double m_dOmega, m_dLevel;
+	//applied to the current wavetable oscillator on top of k_fWaveTableGain, see getOscGain
+	float m_fOscGain;
+	//same, for the sub osc of the current note. m_fSubOscLevel comes on top of it
+	float m_fSubOscGain;
+	AdsrEnvelope m_oEnvelope;
+	WaveTypes m_eCurWaveType;
+	const WaveTableBankLoader& m_oWaveTables;
+	//one oscillator per wave type, indexed by WaveTypes
+	WaveTableOsc m_aWaveTableOscs[totalWaveTypes];
+	//the one for the current note, bound in startNote. nullptr when we're not using wavetables
+	WaveTableOsc* m_pCurWaveTableOsc;
+	//sub oscillator, at half the phase increment of the current one
+	WaveTableOsc m_oSubOsc;
+	bool m_bSubOscOn;
+	bool m_bSubOscPlaying;	//whether the current note has a sub
+	WaveTypes m_eSubOscWaveType;
+	float m_fSubOscLevel;
+	//only used when k_bUseWaveTables is false
+	AdditiveOsc m_oAdditiveOsc;
+	AdditiveOsc m_oAdditiveSubOsc;
+	//mono block we render into before adding it to every channel
+	std::vector<float> m_vScratch;
+	//the note we were playing when we got stolen, see startStealFade
+	WaveTableOsc m_oFadeOsc;
+	WaveTableOsc m_oFadeSubOsc;
+	float m_fFadeGain;
+	float m_fFadeSubGain;
+	int m_iFadeSamplesLeft;
+	int m_iFadeLength;
+	bool m_bStealPending;	//between startStealFade and startNote, so that finishNote keeps the fade
+	std::vector<float> m_vFadeScratch;	//also holds the additive sub, which never plays alongside a fade
+	void addStealFade(float* p_pfDest, const int p_iNumSamples);
+	//the synth whose voice pool we're in, and our index in it. See Bmp4Synthesiser
+	Bmp4Synthesiser* m_pSynth;
+	int m_iPoolIndex;
+};
+
+//
+// Bmp4Synthesiser
+//
+// renders all the wavetable voices that play through the whole block with a single WaveTableMixer pass, so that
+// their oscillators share SSE instructions. Every other voice renders itself as usual
+//
+// our voices live in a pool partitioned in place: [0, m_iNumBusyVoices) are playing, the rest are free. Voices tell
+// us when they start and finish, and move between the two parts with a single swap, so finding a free voice is O(1)
+// instead of JUCE's scan of every voice. Only the first m_iPolyphony voices can be busy, and when they all are,
+// findVoiceToSteal only looks at the busy ones, following m_eStealingMode
+//
+// all the sounds are added once, up front, and notes only play the selected one. Switching sounds is then an atomic
+// index store that any thread can do without allocating or taking our lock; it takes effect on the next note, and
+// the notes that are already playing finish with their sound
+//
+class Bmp4Synthesiser : public Synthesiser
+{
+	friend class Bmp4SynthVoice;
+
+public:
+	Bmp4Synthesiser();
+
+	//creates p_iNumVoices voices, ie the max polyphony. Call once, before playing
+	void addBmp4Voices(const WaveTableBankLoader& p_oWaveTables, const int p_iNumVoices);
+
+	//sets the sample rate and sizes our scratch blocks and those of our voices for host blocks of up to p_iMaxBlockSize samples
+	void prepareToPlay(const double p_dSampleRate, const int p_iMaxBlockSize);
+
+	//how many of our voices can play at once. Voices above a lowered polyphony finish their notes, and are then
+	//replaced by stealing
+	void setPolyphony(const int p_iPolyphony);
+	int getPolyphony() const { return m_iPolyphony; }
+	void setVoiceStealingMode(const VoiceStealingModes p_eMode) { m_eStealingMode = p_eMode; }
+	VoiceStealingModes getVoiceStealingMode() const { return m_eStealingMode; }
+
+	//see Bmp4SynthVoice::setSubOscillator
+	void setSubOscillator(const bool p_bOn, const WaveTypes p_eWaveType, const float p_fLevel);
+
+	//p_iIndex is in the order the sounds were added
+	void selectSound(const int p_iIndex) { m_iSelectedSound.store(p_iIndex, std::memory_order_relaxed); }
+	int getSelectedSound() const { return m_iSelectedSound.load(std::memory_order_relaxed); }
+
+	//same as Synthesiser::noteOn, for the selected sound only
+	void noteOn(int p_iMidiChannel, int p_iMidiNoteNumber, float p_fVelocity) override;
+
 protected:
-	double m_dCurrentAngle, m_dOmega, m_dLevel, m_dTailOff;
-    int m_iCurSound;
-	WaveTableOsc m_oWaveTableTriangle;
-	WaveTableOsc m_oWaveTableSawtooth;
-	WaveTableOsc m_oWaveTableSquare;
+	void renderVoices(AudioSampleBuffer& p_oOutputBuffer, int p_iStartSample, int p_iNumSamples) override;
+	SynthesiserVoice* findFreeVoice(SynthesiserSound* p_pSound, int p_iMidiChannel, int p_iMidiNoteNumber, bool p_bStealIfNoneAvailable) const override;
+	SynthesiserVoice* findVoiceToSteal(SynthesiserSound* p_pSound, int p_iMidiChannel, int p_iMidiNoteNumber) const override;
+
+private:
+	//called by the voices
+	void voiceStarted(Bmp4SynthVoice* p_pVoice);
+	void voiceFinished(Bmp4SynthVoice* p_pVoice);
+	void swapPoolVoices(const int p_iIndex1, const int p_iIndex2);
+
+	WaveTableMixer m_oMixer;
+	std::vector<float> m_vMix;
+
+	Array<Bmp4SynthVoice*> m_oVoicePool;
+	int m_iNumBusyVoices;
+	int m_iPolyphony;
+	VoiceStealingModes m_eStealingMode;
+	std::atomic<int> m_iSelectedSound;
 };
 
 #endif //sBMP4_Sounds_h
\ No newline at end of file
@@ -0,0 +1,186 @@
+/*
+ ==============================================================================
+ sBMP4: killer subtractive synth!
+
+ Copyright (C) 2016  BMP4
+
+ Developer: Vincent Berthiaume
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#ifndef sBMP4_BlockLfo_h
+#define sBMP4_BlockLfo_h
+
+#include <cmath>
+#include <atomic>
+#include "constants.h"
+
+//
+// BlockLfo
+//
+// unipolar lfo, in [0, 1], that renders a whole block of modulation at once so that all channels can share it. The
+// phase is a 32 bit fixed point fraction of a cycle: it wraps by itself when it overflows, so there is no wrap test
+// per sample, and it never drifts the way an angle kept in a float does. The sine comes from a table shared by all
+// instances, interpolated linearly; the other shapes are a couple of operations on the phase.
+//
+// every shape starts at .5 and goes up, like (sin + 1) / 2, except the square: it has no .5, so it follows the sign
+// of the sine and starts high for the first half of the cycle. When synced to the host tempo, a cycle lasts
+// m_dBeatsPerCycle quarter notes, and while the host plays the phase follows its song position.
+//
+// the shape and the sync settings can be set from any thread: they are atomics, and the audio thread picks the sync
+// settings up in process(), where it recomputes the phase increment. Everything else belongs to the audio thread.
+//
+class BlockLfo {
+public:
+    BlockLfo()
+        : m_dSampleRate(44100.)
+        , m_dFrequency(k_fDefaultLfoFrHr)
+        , m_dSyncedFrequency(0.)
+        , m_eShape(k_eDefaultLfoShape)
+        , m_bTempoSync(false)
+        , m_dBeatsPerCycle(1.)
+        , m_bSyncChanged(false)
+        , m_uPhase(0)
+        , m_uPhaseInc(0)
+    {
+        updatePhaseInc();
+    }
+
+    void setSampleRate(const double p_dSampleRate) {
+        m_dSampleRate = p_dSampleRate;
+        updatePhaseInc();
+    }
+
+    // in hz, used when we're not synced to the host tempo
+    void setFrequency(const double p_dFrequency) {
+        m_dFrequency = p_dFrequency;
+        updatePhaseInc();
+    }
+
+    // from any thread
+    void setShape(const LfoShapes p_eShape) { m_eShape.store(p_eShape, std::memory_order_relaxed); }
+
+    // p_dBeatsPerCycle in quarter notes, eg .25 for a cycle per sixteenth note. From any thread, takes effect on
+    // the next process()
+    void setTempoSync(const bool p_bOn, const double p_dBeatsPerCycle) {
+        m_dBeatsPerCycle.store(jmax(1. / 64, p_dBeatsPerCycle), std::memory_order_relaxed);
+        m_bTempoSync.store(p_bOn, std::memory_order_relaxed);
+        m_bSyncChanged.store(true, std::memory_order_release);
+    }
+    bool isTempoSynced() const { return m_bTempoSync.load(std::memory_order_relaxed); }
+
+    // call at the start of each host block when synced. Until we get a tempo we keep running at the free frequency
+    void syncToHost(const double p_dBpm, const double p_dPpqPosition, const bool p_bIsPlaying) {
+        applySyncChange();
+        if (!isTempoSynced() || p_dBpm <= 0.) {
+            return;
+        }
+        const double dBeatsPerCycle = m_dBeatsPerCycle.load(std::memory_order_relaxed);
+        m_dSyncedFrequency = p_dBpm / (60. * dBeatsPerCycle);
+        updatePhaseInc();
+        if (p_bIsPlaying) {
+            const double dCycles = p_dPpqPosition / dBeatsPerCycle;
+            m_uPhase = static_cast<uint32>((dCycles - std::floor(dCycles)) * 4294967296.);
+        }
+    }
+
+    void resetPhase() { m_uPhase = 0; }
+
+    // writes the next p_iNumSamples values of the lfo in p_pfDest
+    void process(float* p_pfDest, const int p_iNumSamples) {
+        applySyncChange();
+        uint32 uPhase = m_uPhase;
+        const uint32 uPhaseInc = m_uPhaseInc;
+        const float fPhaseScale = 1.f / 4294967296.f;
+
+        switch (m_eShape.load(std::memory_order_relaxed)) {
+            case lfoTriangle:
+                // a quarter cycle ahead, so it starts at .5 going up
+                for (int idx = 0; idx < p_iNumSamples; ++idx, uPhase += uPhaseInc) {
+                    p_pfDest[idx] = 1.f - 2.f * std::abs((uPhase + 0x40000000u) * fPhaseScale - .5f);
+                }
+                break;
+            case lfoSawtooth:
+                for (int idx = 0; idx < p_iNumSamples; ++idx, uPhase += uPhaseInc) {
+                    p_pfDest[idx] = (uPhase + 0x80000000u) * fPhaseScale;
+                }
+                break;
+            case lfoSquare:
+                for (int idx = 0; idx < p_iNumSamples; ++idx, uPhase += uPhaseInc) {
+                    p_pfDest[idx] = (uPhase < 0x80000000u) ? 1.f : 0.f;
+                }
+                break;
+            default: {
+                const float* pfTable = getSineTable();
+                const int iShift = 32 - k_iLfoTableBits;
+                const uint32 uFracMask = (1u << iShift) - 1;
+                const float fFracScale = 1.f / (1u << iShift);
+                for (int idx = 0; idx < p_iNumSamples; ++idx, uPhase += uPhaseInc) {
+                    const uint32 uIndex = uPhase >> iShift;
+                    const float fFrac = (uPhase & uFracMask) * fFracScale;
+                    p_pfDest[idx] = pfTable[uIndex] + fFrac * (pfTable[uIndex + 1] - pfTable[uIndex]);
+                }
+                break;
+            }
+        }
+        m_uPhase = uPhase;
+    }
+
+private:
+    // one cycle of (sin + 1) / 2, plus the first sample again at the end so we can interpolate past the last one
+    struct SineTable {
+        SineTable() {
+            const int iLen = 1 << k_iLfoTableBits;
+            for (int idx = 0; idx <= iLen; ++idx) {
+                m_afSamples[idx] = static_cast<float>(.5 + .5 * std::sin(2. * double_Pi * idx / iLen));
+            }
+        }
+        float m_afSamples[(1 << k_iLfoTableBits) + 1];
+    };
+
+    static const float* getSineTable() {
+        static const SineTable s_oTable;
+        return s_oTable.m_afSamples;
+    }
+
+    // a new sync setting waits for the next host tempo, so in the meantime we run at the free frequency
+    void applySyncChange() {
+        if (m_bSyncChanged.load(std::memory_order_relaxed) && m_bSyncChanged.exchange(false, std::memory_order_acquire)) {
+            m_dSyncedFrequency = 0.;
+            updatePhaseInc();
+        }
+    }
+
+    void updatePhaseInc() {
+        const double dFrequency = (isTempoSynced() && m_dSyncedFrequency > 0.) ? m_dSyncedFrequency : m_dFrequency;
+        m_uPhaseInc = static_cast<uint32>(jlimit(0., .5, dFrequency / m_dSampleRate) * 4294967296.);
+    }
+
+    double m_dSampleRate;
+    double m_dFrequency;
+    double m_dSyncedFrequency;
+    std::atomic<LfoShapes> m_eShape;
+    std::atomic<bool> m_bTempoSync;
+    std::atomic<double> m_dBeatsPerCycle;
+    // set by setTempoSync, cleared by the audio thread once it recomputed the phase increment
+    std::atomic<bool> m_bSyncChanged;
+
+    // fraction of a cycle, in 1 / 2^32
+    uint32 m_uPhase;
+    uint32 m_uPhaseInc;
+};
+
+#endif  // sBMP4_BlockLfo_h
@@ -0,0 +1,194 @@
+/*
+ ==============================================================================
+ sBMP4: killer subtractive synth!
+
+ Copyright (C) 2016  BMP4
+
+ Developer: Vincent Berthiaume
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#ifndef sBMP4_DelayLine_h
+#define sBMP4_DelayLine_h
+
+#include <cmath>
+#include <atomic>
+#include "constants.h"
+#include "SmoothedParameter.h"
+
+//
+// DelayLine
+//
+// feedback delay with a time in seconds, up to k_fMaxDelayTime, so it sounds the same at any sample rate. The ring
+// buffer has a power of two length, so positions wrap with a mask. Delays are fractional, read with linear
+// interpolation, and the time glides to new values like our other parameters, which bends the pitch of the echoes
+// the way tape delays do. When synced, a repeat lasts m_dBeatsPerRepeat quarter notes at the host tempo.
+//
+// while the time is steady, each channel is processed in spans that end where the read or write position wraps,
+// and that are never longer than the delay, so no sample is read in the span it was written. Each span is then a
+// plain loop over contiguous samples that the compiler can vectorize. While the time glides, every sample has its
+// own read position and we go through the mask sample by sample.
+//
+class DelayLine {
+public:
+    DelayLine()
+        : m_dSampleRate(44100.)
+        , m_iMask(0)
+        , m_iWritePosition(0)
+        , m_bTempoSync(false)
+        , m_dBeatsPerRepeat(1.)
+    {
+        m_oDelayTime.reset(k_fDefaultDelayTime);
+    }
+
+    // allocates the buffer, so not on the audio thread
+    void prepare(const double p_dSampleRate, const int p_iNumChannels) {
+        m_dSampleRate = p_dSampleRate;
+        // 2 extra samples, since the longest delay still needs the sample before it to interpolate
+        const int iCapacity = nextPowerOfTwo(static_cast<int>(std::ceil(k_fMaxDelayTime * p_dSampleRate)) + 2);
+        m_oBuffer.setSize(jmax(1, p_iNumChannels), iCapacity);
+        m_oBuffer.clear();
+        m_iMask = iCapacity - 1;
+        m_iWritePosition = 0;
+        m_oDelayTime.prepare(p_dSampleRate, k_fDelayTimeRampTime);
+    }
+
+    void clear() { m_oBuffer.clear(); }
+
+    // in seconds, from any thread. While synced, the host tempo sets the time instead
+    void setDelayTime(const float p_fSeconds) { m_oDelayTime.setTargetValue(jlimit(0.f, k_fMaxDelayTime, p_fSeconds)); }
+    float getDelayTime() const { return m_oDelayTime.getTargetValue(); }
+
+    // from any thread, like the time. Takes effect on the next syncToHost
+    void setTempoSync(const bool p_bOn, const double p_dBeatsPerRepeat) {
+        m_dBeatsPerRepeat.store(jmax(1. / 64, p_dBeatsPerRepeat), std::memory_order_relaxed);
+        m_bTempoSync.store(p_bOn, std::memory_order_relaxed);
+    }
+    bool isTempoSynced() const { return m_bTempoSync.load(std::memory_order_relaxed); }
+
+    // call at the start of each host block when synced
+    void syncToHost(const double p_dBpm) {
+        if (isTempoSynced() && p_dBpm > 0.) {
+            setDelayTime(static_cast<float>(m_dBeatsPerRepeat.load(std::memory_order_relaxed) * 60. / p_dBpm));
+        }
+    }
+
+    // while the delay is bypassed, keeps the time gliding as if we had processed p_iNumSamples
+    void skip(const int p_iNumSamples) {
+        m_oDelayTime.update();
+        m_oDelayTime.skip(p_iNumSamples);
+    }
+
+    //
+    // process
+    //
+    // adds the echoes to [p_iStartSample, p_iStartSample + p_iNumSamples) of every channel of p_oBuffer, and feeds
+    // the line with (echo + input) * p_pfFeedback[i]. Extra channels, if any, are left dry
+    //
+    void process(AudioSampleBuffer& p_oBuffer, const int p_iStartSample, const int p_iNumSamples, const float* p_pfFeedback) {
+        const int iNumChannels = jmin(p_oBuffer.getNumChannels(), m_oBuffer.getNumChannels());
+        m_oDelayTime.update();
+
+        for (int iCurSample = 0; iCurSample < p_iNumSamples; ) {
+            const int iNumSamples = jmin(p_iNumSamples - iCurSample, static_cast<int>(k_iMaxSubBlockSize));
+            const bool bIsGliding = m_oDelayTime.isSmoothing();
+            float fDelay = 0.f;
+            if (bIsGliding) {
+                m_oDelayTime.getNextBlock(m_afDelays, iNumSamples);
+                for (int idx = 0; idx < iNumSamples; ++idx) {
+                    m_afDelays[idx] = toDelayInSamples(m_afDelays[idx]);
+                }
+            } else {
+                fDelay = toDelayInSamples(m_oDelayTime.getCurrentValue());
+            }
+
+            for (int iCurChannel = 0; iCurChannel < iNumChannels; ++iCurChannel) {
+                float* pfData = p_oBuffer.getWritePointer(iCurChannel, p_iStartSample + iCurSample);
+                float* pfLine = m_oBuffer.getWritePointer(iCurChannel);
+                if (bIsGliding) {
+                    processGliding(pfData, pfLine, iNumSamples, p_pfFeedback + iCurSample);
+                } else {
+                    processSteady(pfData, pfLine, iNumSamples, fDelay, p_pfFeedback + iCurSample);
+                }
+            }
+            m_iWritePosition = (m_iWritePosition + iNumSamples) & m_iMask;
+            iCurSample += iNumSamples;
+        }
+    }
+
+private:
+    // at least 1 sample, so we only read samples that are already written, and at most what the buffer can hold
+    float toDelayInSamples(const float p_fSeconds) const {
+        return jlimit(1.f, static_cast<float>(m_iMask - 1), static_cast<float>(p_fSeconds * m_dSampleRate));
+    }
+
+    void processSteady(float* p_pfData, float* p_pfLine, const int p_iNumSamples, const float p_fDelay, const float* p_pfFeedback) const {
+        const int iCapacity = m_iMask + 1;
+        const int iDelay = static_cast<int>(p_fDelay);
+        const float fFrac = p_fDelay - iDelay;
+        int iWrite = m_iWritePosition;
+        for (int iCurSample = 0; iCurSample < p_iNumSamples; ) {
+            // the echo is between iRead and the sample before it
+            const int iRead = (iWrite - iDelay) & m_iMask;
+            const int iReadBefore = (iRead - 1) & m_iMask;
+            const int iSpan = jmin(jmin(p_iNumSamples - iCurSample, iDelay), jmin(iCapacity - iWrite, iCapacity - iRead, iCapacity - iReadBefore));
+
+            const float* pfRead = p_pfLine + iRead;
+            const float* pfReadBefore = p_pfLine + iReadBefore;
+            float* pfWrite = p_pfLine + iWrite;
+            float* pfData = p_pfData + iCurSample;
+            const float* pfFeedback = p_pfFeedback + iCurSample;
+            for (int idx = 0; idx < iSpan; ++idx) {
+                const float fIn = pfData[idx];
+                const float fEcho = pfRead[idx] + fFrac * (pfReadBefore[idx] - pfRead[idx]);
+                pfData[idx] = fIn + fEcho;
+                pfWrite[idx] = (fEcho + fIn) * pfFeedback[idx];
+            }
+            iCurSample += iSpan;
+            iWrite = (iWrite + iSpan) & m_iMask;
+        }
+    }
+
+    void processGliding(float* p_pfData, float* p_pfLine, const int p_iNumSamples, const float* p_pfFeedback) const {
+        int iWrite = m_iWritePosition;
+        for (int idx = 0; idx < p_iNumSamples; ++idx) {
+            const int iDelay = static_cast<int>(m_afDelays[idx]);
+            const float fFrac = m_afDelays[idx] - iDelay;
+            const int iRead = (iWrite - iDelay) & m_iMask;
+            const float fRead = p_pfLine[iRead];
+            const float fEcho = fRead + fFrac * (p_pfLine[(iRead - 1) & m_iMask] - fRead);
+            const float fIn = p_pfData[idx];
+            p_pfData[idx] = fIn + fEcho;
+            p_pfLine[iWrite] = (fEcho + fIn) * p_pfFeedback[idx];
+            iWrite = (iWrite + 1) & m_iMask;
+        }
+    }
+
+    AudioSampleBuffer m_oBuffer;
+    double m_dSampleRate;
+    int m_iMask;
+    int m_iWritePosition;
+
+    // in seconds
+    SmoothedParameter m_oDelayTime;
+    std::atomic<bool> m_bTempoSync;
+    std::atomic<double> m_dBeatsPerRepeat;
+
+    // delay of each sample of the current span, in samples, while the time glides
+    float m_afDelays[k_iMaxSubBlockSize];
+};
+
+#endif  // sBMP4_DelayLine_h
@@ -34,52 +34,102 @@ AudioProcessor* JUCE_CALLTYPE createPluginFilter();
 //==============================================================================
 sBMP4AudioProcessor::sBMP4AudioProcessor()
 : AudioProcessor (getBusesProperties())//m_oLastDimensions()
-, m_oDelayBuffer(2, 12000)
-, m_fGain(k_fDefaultGain)
-, m_fDelay(k_fDefaultDelay)
 , m_fQHr(k_fDefaultQHr)
 , m_fFilterFr(k_fDefaultFilterFr)
 , m_fLfoFrHr(k_fDefaultLfoFrHr)
-, m_fLfoAngle(0.)
-, m_fLfoOmega(0.)
 , m_bLfoIsOn(true)
 , m_bSubOscIsOn(true)
-, m_iDelayPosition(0)
+, m_eSubOscWave(k_eDefaultSubOscWave)
+, m_fSubOscLevel(k_fDefaultSubOscLevel)
+, m_iMinSubBlockSize(k_iMinSubBlockSize)
+, m_uBypassedEffects(0)
+, m_uAppliedBypassedEffects(0)
+, m_iBypassFadeLength(1)
 #if USE_SIMPLEST_LP
 , m_iCurBufferSize(0)
 #endif
 {
-    for(int iCurVox = 0; iCurVox < k_iNumberOfVoices; ++iCurVox){
-		Bmp4SynthVoice* voice = new Bmp4SynthVoice();
-        m_oSynth.addVoice(voice);
-		JUCE_COMPILER_WARNING("this adding samplerVoices interacting with the other voices in any way?")
-		m_oSynth.addVoice (new SamplerVoice());    // and these ones play the sampled sounds
+    //only the sine is synthesized when we use sampled sounds, so we always need our voices
+    m_oSynth.addBmp4Voices(m_oWaveTables, k_iMaxNumberOfVoices);
+    if (k_bUseSampledSound){
+        for(int iCurVox = 0; iCurVox < k_iNumberOfVoices; ++iCurVox){
+            m_oSynth.addVoice (new SamplerVoice());    // these ones play the sampled sounds
+        }
+    }
+    updateSubOsc();
+
+    //every wave gets its sound now, so that changing waves never allocates or decodes anything
+    for (int iCurWave = 0; iCurWave < totalWaveTypes; ++iCurWave){
+        const WaveTypes eWave = static_cast<WaveTypes>(iCurWave);
+        //only the sine is synthesized when we use sampled sounds
+        SynthesiserSound::Ptr pSound = k_bUseSampledSound ? m_pSampledSounds->getSound(eWave) : nullptr;
+        if (pSound == nullptr){
+            pSound = new Bmp4Sound(eWave);
+        }
+        m_oSynth.addSound(pSound);
     }
-
     setWaveType(k_fDefaultWave);
 
+    for (int iCurParam = 0; iCurParam < paramTotalNum; ++iCurParam){
+        m_aoParameters[iCurParam].reset(getParameterDefaultValue(iCurParam));
+    }
+    m_aoParameters[paramLfoOn].reset(m_bLfoIsOn ? 1.f : 0.f);
+    m_aoParameters[paramSubOscOn].reset(m_bSubOscIsOn ? 1.f : 0.f);
+
+    const EffectStages aeDefaultOrder[totalEffectStages] = {effectFilter, effectLfo, effectGain, effectDelay};
+    setEffectOrder(aeDefaultOrder);
+    std::fill(m_aiBypassFadeLeft, m_aiBypassFadeLeft + totalEffectStages, 0);
+
 	//width of 265 is 20 (x buffer on left) + 3*75 (3 sliders) + 20 (buffer on right)
 	m_oLastDimensions = std::make_pair(2*k_iXMargin + k_iNumberOfHorizontalSliders*k_iSliderWidth, 
 									   k_iYMargin   + k_iNumberOfVerticaltalSliders * (k_iSliderHeight + k_iLabelHeight) + k_iKeyboardHeight);
 }
 
+void sBMP4AudioProcessor::setInterpolationMode(InterpolationModes p_eMode) {
+    //voices only read the mode at the start of a block, so this is safe to call while playing
+    const ScopedLock oLock(m_oSynth.getLock());
+    for (int iCurVox = 0; iCurVox < m_oSynth.getNumVoices(); ++iCurVox){
+        if (Bmp4SynthVoice* pVoice = dynamic_cast<Bmp4SynthVoice*>(m_oSynth.getVoice(iCurVox))){
+            pVoice->setInterpolationMode(p_eMode);
+        }
+    }
+}
+
 void sBMP4AudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock) {
     m_fSampleRate = sampleRate;
-    m_oSynth.setCurrentPlaybackSampleRate(sampleRate);
+    m_oSynth.prepareToPlay(sampleRate, samplesPerBlock);
+    if (k_bUseWaveTables){
+        //nothing plays the banks of the previous rate once the voices are stopped, so the loader can let them go
+        m_oSynth.allNotesOff(0, false);
+        m_oWaveTables.prepare(sampleRate);
+    }
 
 #if USE_SIMPLEST_LP
     for(int iCurChannel = 0; iCurChannel < 2; ++iCurChannel)
         for(int iCurSample = 0; iCurSample < m_iCurBufferSize; ++iCurSample)
             m_oLookBackVec[iCurChannel][iCurSample] = 0.f;
-#else
-    updateSimpleFilter();
 #endif
 
-	setLfoFr01(getLfoFr01());
-	setFilterFr01(m_fFilterFr);
+    //the audio thread isn't running, so we can jump straight to whatever the host set in the meantime
+    for (int iCurParam = 0; iCurParam < paramTotalNum; ++iCurParam){
+        m_aoParameters[iCurParam].prepare(sampleRate, isSmoothedParameter(iCurParam) ? k_fParameterRampTime : 0.f);
+        if (!isSmoothedParameter(iCurParam)){
+            applySwitchParameter(iCurParam, m_aoParameters[iCurParam].getTargetValue());
+        }
+    }
+	m_oLfo.setSampleRate(sampleRate);
+	setLfoFr01(m_aoParameters[paramLfoFr].getCurrentValue());
+	setFilter01(m_aoParameters[paramFilterFr].getCurrentValue(), m_aoParameters[paramQ].getCurrentValue());
     
     m_oKeyboardState.reset();
-    m_oDelayBuffer.clear();
+    m_oDelay.prepare(sampleRate, getTotalNumOutputChannels());
+    m_oSubBlockMidi.ensureSize(4096);
+
+    //no need to fade bypass changes while we're not playing
+    m_iBypassFadeLength = jmax(1, roundToInt(k_fBypassFadeTime * sampleRate));
+    m_uAppliedBypassedEffects = m_uBypassedEffects.load(std::memory_order_relaxed);
+    std::fill(m_aiBypassFadeLeft, m_aiBypassFadeLeft + totalEffectStages, 0);
+    m_oDryTile.setSize(jmax(1, getTotalNumOutputChannels()), k_iEffectsTileSize);
 }
 
 bool sBMP4AudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
@@ -109,117 +159,257 @@ AudioProcessor::BusesProperties sBMP4AudioProcessor::getBusesProperties()
                             .withOutput ("Output", AudioChannelSet::stereo(), true);
 }
 
-void sBMP4AudioProcessor::addSubOscMidiNotes(MidiBuffer& midiMessages){
-
-    MidiBuffer::Iterator it(midiMessages);
-    MidiMessage msg;
-    MidiBuffer allSubOscMessages;
-    int iPosition;
-    while(it.getNextEvent(msg, iPosition)){
-        if(msg.isNoteOn() || msg.isNoteOff()){
-            MidiMessage curSubOscMsg(msg);
-            curSubOscMsg.setNoteNumber(curSubOscMsg.getNoteNumber() - 12);
-            allSubOscMessages.addEvent(curSubOscMsg, iPosition);
-        }
-    }
-    midiMessages.addEvents(allSubOscMessages, 0, -1, 0);
+//the sub osc is a second oscillator inside each voice, see Bmp4SynthVoice::setSubOscillator. The settings are read
+//under the synth lock, so whichever thread updates last sends the latest ones
+void sBMP4AudioProcessor::updateSubOsc(){
+    const ScopedLock oLock(m_oSynth.getLock());
+    m_oSynth.setSubOscillator(m_bSubOscIsOn.load(), m_eSubOscWave.load(), m_fSubOscLevel.load());
 }
 
+//
+// processBlock
+//
+// the block is split into sub-blocks at midi events, and at least every k_iMaxSubBlockSize samples. Before each
+// sub-block we pick up the parameters the host set in the meantime, so changes and notes line up with the effects
+// instead of all landing at the start of big host blocks. Events closer than m_iMinSubBlockSize to the start of
+// a sub-block don't split it; the synth still plays them on their exact sample
+//
 void sBMP4AudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages) {
    
     int numSamples = buffer.getNumSamples();
 
     //put messages in midiMessages if keys are pressed
     m_oKeyboardState.processNextMidiBuffer (midiMessages, 0, numSamples, true);
-    
-	if (m_bSubOscIsOn) {
-        //copy notes to 1 octave lower
-        addSubOscMidiNotes(midiMessages);
-	}
 
-    //generate audio from midi events
-    m_oSynth.renderNextBlock (buffer, midiMessages, 0, numSamples);
-	
-#if !USE_SIMPLEST_LP
-//    if (m_bIsMonoTEMP)
-//        m_simpleFilterMono.process(numSamples, buffer.getArrayOfWritePointers());
-//    else
-        m_simpleFilterStereo.process(numSamples, buffer.getArrayOfWritePointers());
-#endif
+    //a synced lfo or delay picks up the tempo and song position once per block
+    AudioPlayHead::CurrentPositionInfo oPosition;
+    if ((m_oLfo.isTempoSynced() || m_oDelay.isTempoSynced()) && getPlayHead() != nullptr && getPlayHead()->getCurrentPosition(oPosition)){
+        m_oLfo.syncToHost(oPosition.bpm, oPosition.ppqPosition, oPosition.isPlaying);
+        m_oDelay.syncToHost(oPosition.bpm);
+    }
 
-    //----LFO
-    if(m_bLfoIsOn){
-        float *in1 = buffer.getWritePointer(0);
-        float *in2 = buffer.getWritePointer(1);
-        for(int i = 0; i < numSamples; ++i){        
-            in1[i] *= (sin(m_fLfoAngle) + 1) / 2;
-            in2[i] *= (sin(m_fLfoAngle) + 1) / 2;
-            //printSamples(
-            JUCE_COMPILER_WARNING("on the first note on after all notes are off, this angle should be reset to 0")
-                m_fLfoAngle += m_fLfoOmega;
-            if(m_fLfoAngle > 2 * M_PI){
-                m_fLfoAngle -= 2 * M_PI;
+    MidiBuffer::Iterator oMidiIterator(midiMessages);
+    MidiMessage oMidiMessage;
+    int iNextEventPosition = 0;
+    bool bHasNextEvent = oMidiIterator.getNextEvent(oMidiMessage, iNextEventPosition);
+
+    for (int iStartSample = 0; iStartSample < numSamples; ) {
+        while (bHasNextEvent && iNextEventPosition < iStartSample + m_iMinSubBlockSize) {
+            bHasNextEvent = oMidiIterator.getNextEvent(oMidiMessage, iNextEventPosition);
+        }
+        int iEndSample = jmin(numSamples, iStartSample + k_iMaxSubBlockSize);
+        if (bHasNextEvent && iNextEventPosition < iEndSample) {
+            iEndSample = iNextEventPosition;
+        }
+        const int iNumSamples = iEndSample - iStartSample;
+
+        updateParameters();
+
+        //generate audio from midi events. The synth handles the events after its range right away, so only give it ours
+        m_oSubBlockMidi.clear();
+        m_oSubBlockMidi.addEvents(midiMessages, iStartSample, iNumSamples, 0);
+        m_oSynth.renderNextBlock (buffer, m_oSubBlockMidi, iStartSample, iNumSamples);
+
+        processEffects(buffer, iStartSample, iNumSamples);
+        iStartSample = iEndSample;
+    }
+}
+
+//
+// processEffects
+//
+// instead of running each effect over the whole sub-block, we run all of them on a tile of k_iEffectsTileSize
+// samples before moving on to the next one, so the tile stays in L1 from the filter to the delay. Every stage works
+// in place on the buffer, so reordering or bypassing stages is just a matter of which ones we call, in which order.
+// Bypassing a stage or putting it back crossfades it with the dry signal over k_fBypassFadeTime, and a bypassed
+// stage keeps its ramps going so it picks up where they are when it comes back
+//
+void sBMP4AudioProcessor::processEffects(AudioSampleBuffer& buffer, int p_iStartSample, int numSamples) {
+    //the lfo frequency only needs to follow its ramp once per sub-block
+    if (m_aoParameters[paramLfoFr].isSmoothing()){
+        setLfoFr01(m_aoParameters[paramLfoFr].skip(numSamples));
+    }
+
+    //read once, so a change from another thread only applies from the next sub-block
+    const uint32 uOrder = m_uEffectOrder.load(std::memory_order_relaxed);
+    const uint32 uBypassed = m_uBypassedEffects.load(std::memory_order_relaxed);
+
+    //a stage that changes again while it's still fading turns around from where it is
+    const uint32 uToggled = uBypassed ^ m_uAppliedBypassedEffects;
+    for (int iCurStage = 0; iCurStage < totalEffectStages; ++iCurStage){
+        if (uToggled & (1u << iCurStage)){
+            m_aiBypassFadeLeft[iCurStage] = m_iBypassFadeLength - m_aiBypassFadeLeft[iCurStage];
+        }
+    }
+    m_uAppliedBypassedEffects = uBypassed;
+
+    for (int iCurSample = 0; iCurSample < numSamples; iCurSample += k_iEffectsTileSize){
+        const int iNumSamples = jmin(k_iEffectsTileSize, numSamples - iCurSample);
+        for (int iCurStage = 0; iCurStage < totalEffectStages; ++iCurStage){
+            const EffectStages eStage = static_cast<EffectStages>((uOrder >> (4 * iCurStage)) & 0xf);
+            if (m_aiBypassFadeLeft[eStage] > 0){
+                processFadingEffectStage(eStage, buffer, p_iStartSample + iCurSample, iNumSamples);
+            } else if ((uBypassed & (1u << eStage)) == 0){
+                processEffectStage(eStage, buffer, p_iStartSample + iCurSample, iNumSamples);
+            } else {
+                skipEffectStage(eStage, iNumSamples);
             }
         }
     }
+}
+
+void sBMP4AudioProcessor::processFadingEffectStage(EffectStages p_eStage, AudioSampleBuffer& buffer, int p_iStartSample, int numSamples) {
+    const int iNumChannels = jmin(buffer.getNumChannels(), m_oDryTile.getNumChannels());
+    for (int iCurChannel = 0; iCurChannel < iNumChannels; ++iCurChannel){
+        m_oDryTile.copyFrom(iCurChannel, 0, buffer, iCurChannel, p_iStartSample, numSamples);
+    }
+    processEffectStage(p_eStage, buffer, p_iStartSample, numSamples);
+
+    //how much of the wet signal we keep on each sample, going down to 0 when bypassing and up to 1 when coming back
+    const bool bBypassing = (m_uAppliedBypassedEffects & (1u << p_eStage)) != 0;
+    int& iFadeLeft = m_aiBypassFadeLeft[p_eStage];
+    const float fStep = 1.f / m_iBypassFadeLength;
+    for (int idx = 0; idx < numSamples; ++idx){
+        const float fBypassGain = jmax(0, iFadeLeft - idx - 1) * fStep;
+        m_afBypassRamp[idx] = bBypassing ? fBypassGain : 1.f - fBypassGain;
+    }
+    iFadeLeft = jmax(0, iFadeLeft - numSamples);
+
+    //dry + (wet - dry) * ramp
+    for (int iCurChannel = 0; iCurChannel < iNumChannels; ++iCurChannel){
+        float* pfData = buffer.getWritePointer(iCurChannel, p_iStartSample);
+        const float* pfDry = m_oDryTile.getReadPointer(iCurChannel);
+        FloatVectorOperations::subtract(pfData, pfDry, numSamples);
+        FloatVectorOperations::multiply(pfData, m_afBypassRamp, numSamples);
+        FloatVectorOperations::add(pfData, pfDry, numSamples);
+    }
+}
 
+void sBMP4AudioProcessor::skipEffectStage(EffectStages p_eStage, int numSamples) {
+    switch (p_eStage){
+    case effectFilter: {
+        //the filter is redesigned as it glides, so that it's ready when it comes back
+        SmoothedParameter& oFilterFr = m_aoParameters[paramFilterFr];
+        SmoothedParameter& oFilterQ = m_aoParameters[paramQ];
+        if (oFilterFr.isSmoothing() || oFilterQ.isSmoothing()){
+            setFilter01(oFilterFr.skip(numSamples), oFilterQ.skip(numSamples));
+        }
+        break;
+    }
+    case effectGain:
+        m_aoParameters[paramGain].skip(numSamples);
+        break;
+    case effectDelay:
+        m_aoParameters[paramDelay].skip(numSamples);
+        m_oDelay.skip(numSamples);
+        break;
+    //the lfo frequency follows its ramp in processEffects, bypassed or not
+    default:
+        break;
+    }
+}
 
-	int iDelayPosition = 0;
-    for (int iCurChannel = 0; iCurChannel < buffer.getNumChannels(); ++iCurChannel){
-		//-----GAIN
-		buffer.applyGain(iCurChannel, 0, buffer.getNumSamples(), m_fGain);
-		float* channelData = buffer.getWritePointer (iCurChannel);
-        
-        //-----FILTER
+//one effect on one tile. Ramps shared by all channels are rendered once per tile, in our tile-sized scratch blocks
+void sBMP4AudioProcessor::processEffectStage(EffectStages p_eStage, AudioSampleBuffer& buffer, int p_iStartSample, int numSamples) {
+    jassert(numSamples <= k_iEffectsTileSize);
+    switch (p_eStage){
+    case effectFilter: {
+        //while the cutoff or q glide, the filter is redesigned once per tile
+        SmoothedParameter& oFilterFr = m_aoParameters[paramFilterFr];
+        SmoothedParameter& oFilterQ = m_aoParameters[paramQ];
+        if (oFilterFr.isSmoothing() || oFilterQ.isSmoothing()){
+            setFilter01(oFilterFr.skip(numSamples), oFilterQ.skip(numSamples));
+        }
 #if USE_SIMPLEST_LP
-        simplestLP(channelData, numSamples, m_oLookBackVec[iCurChannel]);
+        for (int iCurChannel = 0; iCurChannel < jmin(2, buffer.getNumChannels()); ++iCurChannel){
+            simplestLP(buffer.getWritePointer(iCurChannel, p_iStartSample), numSamples, m_oLookBackVec[iCurChannel]);
+        }
+#else
+        float* apfChannels[2];
+        for (int iCurChannel = 0; iCurChannel < 2; ++iCurChannel){
+            apfChannels[iCurChannel] = buffer.getWritePointer(jmin(iCurChannel, buffer.getNumChannels() - 1), p_iStartSample);
+        }
+//        if (m_bIsMonoTEMP)
+//            m_simpleFilterMono.process(numSamples, apfChannels);
+//        else
+            m_simpleFilterStereo.process(numSamples, apfChannels);
 #endif
-		//-----DELAY AND LFO
-		float* delayData = m_oDelayBuffer.getWritePointer(jmin(iCurChannel, m_oDelayBuffer.getNumChannels() - 1));
-		iDelayPosition = m_iDelayPosition;
-		for (int i = 0; i < numSamples; ++i) {
-			const float in = channelData[i];
-			//----DELAY
-			channelData[i] += delayData[iDelayPosition];
-			delayData[iDelayPosition] = (delayData[iDelayPosition] + in) * m_fDelay;
-			if (++iDelayPosition >= m_oDelayBuffer.getNumSamples()) {
-				iDelayPosition = 0;
-			}
-		}
+        break;
+    }
+
+    case effectLfo:
+        if(m_bLfoIsOn){
+            JUCE_COMPILER_WARNING("on the first note on after all notes are off, the lfo phase should be reset to 0")
+            m_oLfo.process(m_afLfoBlock, numSamples);
+            for (int iCurChannel = 0; iCurChannel < buffer.getNumChannels(); ++iCurChannel){
+                FloatVectorOperations::multiply(buffer.getWritePointer(iCurChannel, p_iStartSample), m_afLfoBlock, numSamples);
+            }
+        }
+        break;
+
+    case effectGain: {
+        SmoothedParameter& oGain = m_aoParameters[paramGain];
+        if (oGain.isSmoothing()){
+            oGain.getNextBlock(m_afGainRamp, numSamples);
+            for (int iCurChannel = 0; iCurChannel < buffer.getNumChannels(); ++iCurChannel){
+                FloatVectorOperations::multiply(buffer.getWritePointer(iCurChannel, p_iStartSample), m_afGainRamp, numSamples);
+            }
+        } else {
+            for (int iCurChannel = 0; iCurChannel < buffer.getNumChannels(); ++iCurChannel){
+                buffer.applyGain(iCurChannel, p_iStartSample, numSamples, oGain.getCurrentValue());
+            }
+        }
+        break;
+    }
+
+    case effectDelay:
+        m_aoParameters[paramDelay].getNextBlock(m_afDelayRamp, numSamples);
+        m_oDelay.process(buffer, p_iStartSample, numSamples, m_afDelayRamp);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void sBMP4AudioProcessor::setEffectOrder(const EffectStages* p_peOrder) {
+    static_assert(totalEffectStages <= 8, "m_uEffectOrder has 4 bits per stage");
+    uint32 uOrder = 0;
+    uint32 uStagesSeen = 0;
+    for (int iCurStage = 0; iCurStage < totalEffectStages; ++iCurStage){
+        uOrder |= static_cast<uint32>(p_peOrder[iCurStage]) << (4 * iCurStage);
+        uStagesSeen |= 1u << p_peOrder[iCurStage];
+    }
+    //every stage needs to be there exactly once
+    if (uStagesSeen != (1u << totalEffectStages) - 1){
+        jassertfalse;
+        return;
+    }
+    m_uEffectOrder.store(uOrder, std::memory_order_relaxed);
+}
+
+void sBMP4AudioProcessor::setEffectBypassed(EffectStages p_eStage, bool p_bBypassed) {
+    if (p_bBypassed){
+        m_uBypassedEffects.fetch_or(1u << p_eStage, std::memory_order_relaxed);
+    } else {
+        m_uBypassedEffects.fetch_and(~(1u << p_eStage), std::memory_order_relaxed);
     }
-    m_iDelayPosition = iDelayPosition;
 }
 
 //the argument to this will be [0, 1], which we need to convert to [kmin, kmax]
 void sBMP4AudioProcessor::setLfoFr01(float fr01){
     m_fLfoFrHr = convert01ToHr(fr01, k_fMinLfoFr, k_fMaxLfoFr);
-	m_fLfoOmega = 2 * M_PI*m_fLfoFrHr / m_fSampleRate;		//dividing the frequency by the sample rate essentially gives us the frequency in samples
-}
-
-//m_fLfoFrHr is stored internally as [kmin, kmax], and we need here to return something [0, 1]
-float sBMP4AudioProcessor::getLfoFr01() {
-	return convertHrTo01(m_fLfoFrHr, k_fMinLfoFr, k_fMaxLfoFr);
+	m_oLfo.setFrequency(m_fLfoFrHr);
 }
 
-void sBMP4AudioProcessor::setFilterFr01(float filterFr){
+//both at once, so gliding them only redesigns the filter once. Audio thread only
+void sBMP4AudioProcessor::setFilter01(float filterFr, float p_fQ01){
     m_fFilterFr = filterFr;
+	m_fQHr = convert01ToHr(p_fQ01, k_fMinQHr, k_fMaxQHr);
 
 #if USE_SIMPLEST_LP
     m_iCurBufferSize = static_cast<int>((1-m_fFilterFr)*k_iMaxSampleToAverageOver);
 #else
-    if(m_oSynth.getSampleRate() > 0){
-        updateSimpleFilter();
-    }
-#endif
-}
-
-float sBMP4AudioProcessor::getFilterQ01(){
-	return convertHrTo01(m_fQHr, k_fMinQHr, k_fMaxQHr);
-}
-
-void sBMP4AudioProcessor::setFilterQ01(float p_fQ01){
-	m_fQHr = convert01ToHr(p_fQ01, k_fMinQHr, k_fMaxQHr);
-#if !USE_SIMPLEST_LP
     updateSimpleFilter();
 #endif
 }
@@ -287,30 +477,48 @@ float sBMP4AudioProcessor::getParameter(int index) {
 	// This method will be called by the host, probably on the audio thread, so
 	// it's absolutely time-critical. Don't use critical sections or anything
 	// UI-related, or anything at all that may block in any way!
-	switch(index) {
-	case paramGain:     return m_fGain;
-	case paramDelay:    return m_fDelay;
-	case paramWave:     return m_fWave;
-	case paramFilterFr: return m_fFilterFr;
-	case paramQ:		return getFilterQ01();
-	case paramLfoFr:	return getLfoFr01();
-	case paramLfoOn:	return getLfoOn();
-	case paramSubOscOn:	return getSubOscOn();
-	default:            return 0.0f;
+	if (index < 0 || index >= paramTotalNum) {
+		return 0.0f;
 	}
+	//the value the host set, even if the audio thread is still gliding to it
+	return m_aoParameters[index].getTargetValue();
 }
 
 void sBMP4AudioProcessor::setParameter(int index, float newValue) {
 	// This method will be called by the host, probably on the audio thread, so
 	// it's absolutely time-critical. Don't use critical sections or anything
 	// UI-related, or anything at all that may block in any way!
+	if (index < 0 || index >= paramTotalNum) {
+		return;
+	}
+	//processBlock picks it up before its next sub-block. If it's set again before that, the latest value wins
+	m_aoParameters[index].setTargetValue(newValue);
+}
+
+//gain, delay, filter and lfo glide to their new values, the others are switches and jump
+bool sBMP4AudioProcessor::isSmoothedParameter(int index) {
+	switch(index) {
+	case paramGain:
+	case paramDelay:
+	case paramFilterFr:
+	case paramQ:
+	case paramLfoFr:	return true;
+	default:			return false;
+	}
+}
+
+void sBMP4AudioProcessor::updateParameters() {
+	for (int iCurParam = 0; iCurParam < paramTotalNum; ++iCurParam) {
+		//smoothed parameters are read from their ramps in processEffects
+		if (m_aoParameters[iCurParam].update() && !isSmoothedParameter(iCurParam)) {
+			applySwitchParameter(iCurParam, m_aoParameters[iCurParam].getCurrentValue());
+		}
+	}
+}
+
+void sBMP4AudioProcessor::applySwitchParameter(int index, float newValue) {
     switch(index) {
-    case paramGain:		m_fGain = newValue;		break;
-    case paramDelay:    m_fDelay = newValue;	break;
     case paramWave:     setWaveType(newValue);  break;
-    case paramFilterFr: setFilterFr01(newValue); break;
-	case paramQ:		setFilterQ01(newValue);	break;
-	case paramLfoFr:	setLfoFr01(newValue);	break;
 	case paramLfoOn:	setLfoOn(newValue);		break;
 	case paramSubOscOn:	setSubOscOn(newValue);	break;
 
@@ -318,71 +526,15 @@ void sBMP4AudioProcessor::setParameter(int index, float newValue) {
     }
 }
 
-void sBMP4AudioProcessor::setWaveType(float p_fWave){
-	m_fWave = p_fWave;
-	JUCE_COMPILER_WARNING("probably the sounds should be loaded by the voices...")
-	m_oSynth.clearSounds();
-	//m_oSynth.clearVoices();
-	if(!k_bUseSampledSound){
-		if(m_fWave == 0){
-			m_oSynth.addSound(new SineWaveSound());
-		} else if(areSame(m_fWave, 1.f / 3)){
-			m_oSynth.addSound(new SquareWaveSound());
-		} else if(areSame(m_fWave, 2.f / 3)){
-			m_oSynth.addSound(new TriangleWaveSound());
-		} else if(m_fWave == 1){
-			m_oSynth.addSound(new SawtoothWaveSound());
-		}
-	} else {
-		if(m_fWave == 0){
-			m_oSynth.addSound(new SineWaveSound());
-		} else if(areSame(m_fWave, 1.f / 3)){
-			WavAudioFormat wavFormat;
-			ScopedPointer<AudioFormatReader> audioReader(wavFormat.createReaderFor(new MemoryInputStream(BinaryData::Microbrute_raw_waves_stems_sBMP4__pulse_wav, BinaryData::Microbrute_raw_waves_stems_sBMP4__pulse_wavSize, false), true));
-			BigInteger allNotes;
-			allNotes.setRange(0, 128, true);
-			m_oSynth.addSound(new SamplerSound("microbrute pulse",
-						   *audioReader,
-						   allNotes,
-						   74,   // root midi note
-						   0.1,  // attack time
-						   0.1,  // release time
-						   20.0  // maximum sample length
-						   ));
-		} else if(areSame(m_fWave, 2.f / 3)){
-			WavAudioFormat wavFormat;
-			ScopedPointer<AudioFormatReader> audioReader(wavFormat.createReaderFor(new MemoryInputStream(BinaryData::Microbrute_raw_waves_stems_sBMP4__triangle_wav, BinaryData::Microbrute_raw_waves_stems_sBMP4__triangle_wavSize, false), true));
-			BigInteger allNotes;
-			allNotes.setRange(0, 128, true);
-			m_oSynth.addSound(new SamplerSound("microbrute triangle",
-						   *audioReader,
-						   allNotes,
-						   74,   // root midi note
-						   0.1,  // attack time
-						   0.1,  // release time
-						   20.0  // maximum sample length
-						   ));
-		} else if(m_fWave == 1){
-			WavAudioFormat wavFormat;
-			ScopedPointer<AudioFormatReader> audioReader(wavFormat.createReaderFor(new MemoryInputStream(BinaryData::Microbrute_raw_waves_stems_sBMP4__sawtooth_wav, BinaryData::Microbrute_raw_waves_stems_sBMP4__sawtooth_wavSize, false), true));
-			BigInteger allNotes;
-			allNotes.setRange(0, 128, true);
-			m_oSynth.addSound(new SamplerSound("microbrute sawtooth",
-						   *audioReader,
-						   allNotes,
-						   74,   // root midi note
-						   0.1,  // attack time
-						   0.1,  // release time
-						   20.0  // maximum sample length
-						   ));
-		}
-	}
+//the wave parameter steps through these
+static const WaveTypes s_aeWaveParameterTypes[] = {sineWave, squareWave, triangleWave, sawtoothWave};
 
-	//HAVING A MONOPHONIC SYNTH MAKES CLICKS BETWEEN NOTES BECAUSE NO TAILING OFF BETWEEN NOTES. could use an adsr or 
-	//to have a polyphonic synth, need to load several voices, like this
-	//for (int i = 4; --i >= 0;){
-	//	m_oSynth.addVoice(new SineWaveVoice());   // These voices will play our custom sine-wave sounds..
-	//}
+//only selects one of the sounds we created in the constructor, so it's safe on the audio thread
+void sBMP4AudioProcessor::setWaveType(float p_fWave){
+	const int iNumWaves = sizeof(s_aeWaveParameterTypes) / sizeof(s_aeWaveParameterTypes[0]);
+	const int iWave = jlimit(0, iNumWaves - 1, roundToInt(p_fWave * (iNumWaves - 1)));
+	//our sounds are added in WaveTypes order
+	m_oSynth.selectSound(s_aeWaveParameterTypes[iWave]);
 }
 
 float sBMP4AudioProcessor::getParameterDefaultValue(int index){
@@ -430,7 +582,7 @@ void sBMP4AudioProcessor::releaseResources(){
 void sBMP4AudioProcessor::reset(){
 	// Use this method as the place to clear any delay lines, buffers, etc, as it
 	// means there's been a break in the audio's continuity.
-	m_oDelayBuffer.clear();
+	m_oDelay.clear();
 }
 
 
@@ -439,14 +591,14 @@ void sBMP4AudioProcessor::getStateInformation (MemoryBlock& destData){
     XmlElement xml ("SBMP4SETTINGS");
     xml.setAttribute ("uiWidth",		m_oLastDimensions.first);
     xml.setAttribute ("uiHeight",		m_oLastDimensions.second);
-    xml.setAttribute ("gain",			m_fGain);
-    xml.setAttribute ("delay",			m_fDelay);
-    xml.setAttribute ("wave",			m_fWave);
-    xml.setAttribute ("filter",			m_fFilterFr);
-	xml.setAttribute ("m_fLfoFrHr",		getLfoFr01());
-	xml.setAttribute ("m_fQHr",			getFilterQ01());
-	xml.setAttribute ("m_bLfoIsOn",		m_bLfoIsOn);
-	xml.setAttribute ("m_bSubOscIsOn",	m_bSubOscIsOn);
+    xml.setAttribute ("gain",			getParameter(paramGain));
+    xml.setAttribute ("delay",			getParameter(paramDelay));
+    xml.setAttribute ("wave",			getParameter(paramWave));
+    xml.setAttribute ("filter",			getParameter(paramFilterFr));
+	xml.setAttribute ("m_fLfoFrHr",		getParameter(paramLfoFr));
+	xml.setAttribute ("m_fQHr",			getParameter(paramQ));
+	xml.setAttribute ("m_bLfoIsOn",		getParameter(paramLfoOn) == 1.f);
+	xml.setAttribute ("m_bSubOscIsOn",	getParameter(paramSubOscOn) == 1.f);
 
     copyXmlToBinary (xml, destData);
 }
@@ -457,14 +609,15 @@ void sBMP4AudioProcessor::setStateInformation (const void* data, int sizeInBytes
         if (xmlState->hasTagName ("SBMP4SETTINGS")) {
             m_oLastDimensions.first  =	xmlState->getIntAttribute(		"uiWidth",		m_oLastDimensions.first);
             m_oLastDimensions.second =	xmlState->getIntAttribute(		"uiHeight",		m_oLastDimensions.second);
-            m_fGain = (float)			xmlState->getDoubleAttribute(	"gain",			m_fGain);
-            m_fDelay = (float)			xmlState->getDoubleAttribute(	"delay",		m_fDelay);
-            setWaveType((float)			xmlState->getDoubleAttribute(	"wave",			m_fWave));
-            m_fFilterFr = (float)       xmlState->getDoubleAttribute(	"filter",		m_fFilterFr);
-            m_fLfoFrHr = convert01ToHr((float)xmlState->getDoubleAttribute(	"m_fLfoFrHr",	getLfoFr01()), k_fMinLfoFr, k_fMaxLfoFr);
-			setFilterQ01((float)		xmlState->getDoubleAttribute(	"m_fQHr",		getFilterQ01()));
-			setLfoOn(					xmlState->getBoolAttribute(		"m_bLfoIsOn",	m_bLfoIsOn));
-			setSubOscOn(				xmlState->getBoolAttribute(		"m_bSubOscIsOn",m_bSubOscIsOn));
+            //these go through the parameters, so a playing instance glides to them like to any other change
+            setParameter(paramGain,		(float)xmlState->getDoubleAttribute(	"gain",			getParameter(paramGain)));
+            setParameter(paramDelay,	(float)xmlState->getDoubleAttribute(	"delay",		getParameter(paramDelay)));
+            setParameter(paramWave,		(float)xmlState->getDoubleAttribute(	"wave",			getParameter(paramWave)));
+            setParameter(paramFilterFr,	(float)xmlState->getDoubleAttribute(	"filter",		getParameter(paramFilterFr)));
+            setParameter(paramLfoFr,	(float)xmlState->getDoubleAttribute(	"m_fLfoFrHr",	getParameter(paramLfoFr)));
+			setParameter(paramQ,		(float)xmlState->getDoubleAttribute(	"m_fQHr",		getParameter(paramQ)));
+			setParameter(paramLfoOn,	xmlState->getBoolAttribute(		"m_bLfoIsOn",	getParameter(paramLfoOn) == 1.f) ? 1.f : 0.f);
+			setParameter(paramSubOscOn,	xmlState->getBoolAttribute(		"m_bSubOscIsOn",getParameter(paramSubOscOn) == 1.f) ? 1.f : 0.f);
         }
     }
 }
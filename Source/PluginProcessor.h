@@ -27,6 +27,13 @@
 
 #include "constants.h"
 #include "DspFilters/Dsp.h"
+#include "WaveTableOsc.h"
+#include "BMP4SynthVoice.h"
+#include "SmoothedParameter.h"
+#include "SampledSoundCache.h"
+#include "BlockLfo.h"
+#include "DelayLine.h"
+#include <atomic>
 
 
 //==============================================================================
@@ -45,7 +52,6 @@ public:
 
     void releaseResources() override;
     void processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages) override;
-    void addSubOscMidiNotes(MidiBuffer& midiMessages);
     void reset() override;
 
     //==============================================================================
@@ -83,9 +89,31 @@ public:
 	void setLfoOn(bool p_bLfoIsOn){	m_bLfoIsOn = p_bLfoIsOn;}
 	void setLfoOn(float p_fLfoIsOn){ (p_fLfoIsOn == 1.) ? m_bLfoIsOn = true : m_bLfoIsOn = false;}
 	bool getLfoOn() { return m_bLfoIsOn;}
-	void setSubOscOn(bool p_bSubOscIsOn){	m_bSubOscIsOn = p_bSubOscIsOn;}
-	void setSubOscOn(float p_fSubOscIsOn){ (p_fSubOscIsOn == 1.) ? m_bSubOscIsOn = true : m_bSubOscIsOn = false;}
+	//not host parameters yet. While synced, the lfo frequency parameter is ignored
+	void setLfoShape(LfoShapes p_eShape) { m_oLfo.setShape(p_eShape); }
+	void setLfoTempoSync(bool p_bOn, double p_dBeatsPerCycle) { m_oLfo.setTempoSync(p_bOn, p_dBeatsPerCycle); }
+	//the delay parameter is the feedback, this is the time between repeats, in seconds. Glides to the new time
+	void setDelayTime(float p_fSeconds) { m_oDelay.setDelayTime(p_fSeconds); }
+	void setDelayTempoSync(bool p_bOn, double p_dBeatsPerRepeat) { m_oDelay.setTempoSync(p_bOn, p_dBeatsPerRepeat); }
+	//the effects after the synth run in this order, filter, lfo, gain and delay by default. p_peOrder has
+	//totalEffectStages entries, each stage once. Both can be called from any thread
+	void setEffectOrder(const EffectStages* p_peOrder);
+	void setEffectBypassed(EffectStages p_eStage, bool p_bBypassed);
+	//the sub osc settings can be set from any thread. p_eWave can be k_eSubOscFollowsNote, the default.
+	//There is no sub on sampled sounds (k_bUseSampledSound), only on the synthesized waves
+	void setSubOscOn(bool p_bSubOscIsOn){	m_bSubOscIsOn = p_bSubOscIsOn; updateSubOsc();}
+	void setSubOscOn(float p_fSubOscIsOn){ setSubOscOn(p_fSubOscIsOn == 1.);}
 	bool getSubOscOn() { return m_bSubOscIsOn;}
+	void setSubOscWave(WaveTypes p_eWave){ m_eSubOscWave = p_eWave; updateSubOsc();}
+	void setSubOscLevel(float p_fLevel){ m_fSubOscLevel = p_fLevel; updateSubOsc();}
+	//trade cpu for aliasing noise, eg hermite on a solo lead and linear on a big pad
+	void setInterpolationMode(InterpolationModes p_eMode);
+	//up to k_iMaxNumberOfVoices, and what happens when a note comes in while they're all playing
+	void setPolyphony(int p_iPolyphony) { m_oSynth.setPolyphony(p_iPolyphony); }
+	int getPolyphony() const { return m_oSynth.getPolyphony(); }
+	void setVoiceStealingMode(VoiceStealingModes p_eMode) { m_oSynth.setVoiceStealingMode(p_eMode); }
+	//processBlock splits blocks at midi events, but not into pieces shorter than this, to cap the overhead
+	void setMinSubBlockSize(int p_iNumSamples) { m_iMinSubBlockSize = jlimit(1, k_iMaxSubBlockSize, p_iNumSamples); }
     //==============================================================================
     void getStateInformation (MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
@@ -100,30 +128,35 @@ private:
 #if USE_SIMPLEST_LP
     void simplestLP(float* p_pfSamples, const int p_iTotalSamples, float* p_fLookBackVec);
 #endif
-    float m_fGain, m_fDelay, m_fWave, m_fFilterFr, m_fLfoFrHr, m_fQHr, m_fLfoAngle, m_fLfoOmega;
+    //what the host sees, see setParameter. The members below are what the audio thread currently uses
+    SmoothedParameter m_aoParameters[paramTotalNum];
+    float m_fFilterFr, m_fLfoFrHr, m_fQHr;
 
 	bool m_bLfoIsOn;
-	bool m_bSubOscIsOn;
+	std::atomic<bool> m_bSubOscIsOn;
+	std::atomic<WaveTypes> m_eSubOscWave;
+	std::atomic<float> m_fSubOscLevel;
+	//sends the sub osc settings to the voices
+	void updateSubOsc();
 
     void setWaveType(float p_fWave);
 
-    void setFilterFr01(float p_fFilterFr);
-
-	void setFilterQ01(float p_fQ);
-	float getFilterQ01();
+    void setFilter01(float p_fFilterFr, float p_fQ);
 
 	void setLfoFr01(float p_fLfoFr);
-	float getLfoFr01();
 
     float m_fSampleRate;
 
     std::pair<int, int> m_oLastDimensions;
 
     //==============================================================================
-    AudioSampleBuffer m_oDelayBuffer;
-    int m_iDelayPosition;
+    DelayLine m_oDelay;
 
-    Synthesiser m_oSynth;
+    //shared by all instances, see SampledSoundCache
+    SharedResourcePointer<SampledSoundCache> m_pSampledSounds;
+    //needs to outlive m_oSynth, since the voices use its banks
+    WaveTableBankLoader m_oWaveTables;
+    Bmp4Synthesiser m_oSynth;
 
 #if USE_SIMPLEST_LP
     int m_iCurBufferSize;
@@ -134,6 +167,38 @@ private:
 //    bool m_bIsMonoTEMP;
 #endif
 
+    //-------sub-block processing, see processBlock
+    //starts ramps to the parameters set since the last call, and applies the ones that aren't smoothed
+    void updateParameters();
+    void applySwitchParameter(int index, float newValue);
+    static bool isSmoothedParameter(int index);
+    //filter, lfo, gain and delay on [p_iStartSample, p_iStartSample + p_iNumSamples)
+    void processEffects(AudioSampleBuffer& p_oBuffer, int p_iStartSample, int p_iNumSamples);
+    void processEffectStage(EffectStages p_eStage, AudioSampleBuffer& p_oBuffer, int p_iStartSample, int p_iNumSamples);
+    //same as processEffectStage, crossfaded with the dry tile while the stage is being bypassed or put back
+    void processFadingEffectStage(EffectStages p_eStage, AudioSampleBuffer& p_oBuffer, int p_iStartSample, int p_iNumSamples);
+    //moves the ramps of a bypassed stage along, so they don't jump when it's put back
+    void skipEffectStage(EffectStages p_eStage, int p_iNumSamples);
+
+    int m_iMinSubBlockSize;
+    //per-sample gain, delay feedback and lfo of the current effects tile
+    float m_afGainRamp[k_iEffectsTileSize];
+    float m_afDelayRamp[k_iEffectsTileSize];
+    float m_afLfoBlock[k_iEffectsTileSize];
+
+    BlockLfo m_oLfo;
+    //4 bits per stage, the first one in the lowest bits. And one bit per bypassed stage
+    std::atomic<uint32> m_uEffectOrder;
+    std::atomic<uint32> m_uBypassedEffects;
+    //the bypassed stages processEffects last saw, and how many samples are left in each stage's bypass crossfade
+    uint32 m_uAppliedBypassedEffects;
+    int m_aiBypassFadeLeft[totalEffectStages];
+    int m_iBypassFadeLength;
+    float m_afBypassRamp[k_iEffectsTileSize];
+    AudioSampleBuffer m_oDryTile;
+    //midi events of the current sub-block, preallocated in prepareToPlay
+    MidiBuffer m_oSubBlockMidi;
+
     static BusesProperties getBusesProperties();
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(sBMP4AudioProcessor)
 };
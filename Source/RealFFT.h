@@ -0,0 +1,161 @@
+/*
+ ==============================================================================
+ sBMP4: killer subtractive synth!
+
+ Copyright (C) 2016  BMP4
+
+ Developer: Vincent Berthiaume
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#ifndef sBMP4_RealFFT_h
+#define sBMP4_RealFFT_h
+
+#include <vector>
+#include <complex>
+#include <cmath>
+
+//
+// RealFFT
+//
+// inverse fft for signals that are known to be real, ie whose spectrum is conjugate-symmetric. Only the
+// first N/2+1 bins are needed; they are folded into a single N/2 points complex ifft, which is computed
+// with radix-4 butterflies (plus one radix-2 stage when log2(N/2) is odd). All twiddles and the bit-reversal
+// permutation are computed once in the constructor, so keep an instance around for each size you need.
+//
+// performInverse() uses an internal work buffer, so a given instance can only be used by one thread at a time.
+//
+class RealFFT {
+public:
+    typedef std::complex<double> Complex;
+
+    // p_iSize is N, the number of real output samples. It needs to be a power of 2, at least 4
+    explicit RealFFT(const int p_iSize)
+        : m_iSize(p_iSize)
+        , m_iHalfSize(p_iSize / 2)
+        , m_vWork(p_iSize / 2)
+    {
+        const double dTwoPi = 2.0 * 3.14159265358979323846;
+
+        //twiddles for the N/2 points complex ifft, and for the real/complex split
+        m_vTwiddles.resize(m_iHalfSize);
+        m_vSplitTwiddles.resize(m_iHalfSize);
+        for (int k = 0; k < m_iHalfSize; ++k) {
+            m_vTwiddles[k]      = std::polar(1.0, dTwoPi * k / m_iHalfSize);
+            m_vSplitTwiddles[k] = std::polar(1.0, dTwoPi * k / m_iSize);
+        }
+
+        m_iLog2HalfSize = 0;
+        while ((1 << m_iLog2HalfSize) < m_iHalfSize) {
+            ++m_iLog2HalfSize;
+        }
+
+        m_vBitReverse.resize(m_iHalfSize);
+        for (int i = 0; i < m_iHalfSize; ++i) {
+            int iReversed = 0;
+            for (int iBit = 0; iBit < m_iLog2HalfSize; ++iBit) {
+                iReversed |= ((i >> iBit) & 1) << (m_iLog2HalfSize - 1 - iBit);
+            }
+            m_vBitReverse[i] = iReversed;
+        }
+    }
+
+    int getSize() const { return m_iSize; }
+
+    //
+    // performInverse
+    //
+    // p_pdRe and p_pdIm hold bins 0 to N/2 of the spectrum X, and p_pdOut receives the N real samples
+    // x[n] = sum over k of X[k] * exp(+2 pi i k n / N). The imaginary parts of bins 0 and N/2 are ignored, since
+    // they have to be 0 for a real signal. Like the old Rabiner & Gold routine, this is not normalized.
+    //
+    void performInverse(const double* p_pdRe, const double* p_pdIm, double* p_pdOut) {
+        const int iHalf = m_iHalfSize;
+
+        //fold the spectrum into Z[k] = Xe[k] + i Xo[k], where Xe and Xo are the spectra of the even and odd samples.
+        //X[k + N/2] is conj(X[N/2 - k]), since the spectrum is conjugate-symmetric
+        for (int k = 0; k < iHalf; ++k) {
+            const Complex oLow (p_pdRe[k], k == 0 ? 0. : p_pdIm[k]);
+            const Complex oHigh(p_pdRe[iHalf - k], k == 0 ? 0. : -p_pdIm[iHalf - k]);
+            const Complex oEven = oLow + oHigh;
+            const Complex oOdd  = (oLow - oHigh) * m_vSplitTwiddles[k];
+            m_vWork[m_vBitReverse[k]] = oEven + Complex(-oOdd.imag(), oOdd.real());
+        }
+
+        performComplexInverseInPlace();
+
+        //even samples are in the real part, odd samples in the imaginary part
+        for (int m = 0; m < iHalf; ++m) {
+            p_pdOut[2 * m]     = m_vWork[m].real();
+            p_pdOut[2 * m + 1] = m_vWork[m].imag();
+        }
+    }
+
+private:
+    // unnormalized complex ifft of m_vWork, which needs to already be in bit-reversed order
+    void performComplexInverseInPlace() {
+        const int iHalf = m_iHalfSize;
+        Complex* pWork = &m_vWork[0];
+        int iSpan = 1;
+
+        //radix-2 stage, only when we can't do everything with radix-4
+        if (m_iLog2HalfSize & 1) {
+            for (int i = 0; i < iHalf; i += 2) {
+                const Complex a0 = pWork[i];
+                const Complex a1 = pWork[i + 1];
+                pWork[i]     = a0 + a1;
+                pWork[i + 1] = a0 - a1;
+            }
+            iSpan = 2;
+        }
+
+        //radix-4 stages, each one combines 4 transforms of iSpan points into one of 4*iSpan points
+        for (; iSpan < iHalf; iSpan *= 4) {
+            const int iBlock  = 4 * iSpan;
+            const int iStride = iHalf / iBlock;	//twiddle table step for this stage
+            for (int iStart = 0; iStart < iHalf; iStart += iBlock) {
+                for (int j = 0; j < iSpan; ++j) {
+                    Complex* p = pWork + iStart + j;
+                    const Complex oA0 = p[0];
+                    const Complex oA1 = p[iSpan]     * m_vTwiddles[2 * j * iStride];
+                    const Complex oA2 = p[2 * iSpan] * m_vTwiddles[j * iStride];
+                    const Complex oA3 = p[3 * iSpan] * m_vTwiddles[3 * j * iStride];
+
+                    const Complex oSum01  = oA0 + oA1;
+                    const Complex oDiff01 = oA0 - oA1;
+                    const Complex oSum23  = oA2 + oA3;
+                    const Complex oDiff23 = oA2 - oA3;
+                    const Complex oRotated(-oDiff23.imag(), oDiff23.real());	//i * oDiff23
+
+                    p[0]         = oSum01 + oSum23;
+                    p[iSpan]     = oDiff01 + oRotated;
+                    p[2 * iSpan] = oSum01 - oSum23;
+                    p[3 * iSpan] = oDiff01 - oRotated;
+                }
+            }
+        }
+    }
+
+    const int m_iSize;
+    const int m_iHalfSize;
+    int m_iLog2HalfSize;
+    std::vector<Complex> m_vTwiddles;
+    std::vector<Complex> m_vSplitTwiddles;
+    std::vector<int> m_vBitReverse;
+    std::vector<Complex> m_vWork;
+};
+
+#endif  // sBMP4_RealFFT_h
@@ -0,0 +1,96 @@
+/*
+ ==============================================================================
+ sBMP4: killer subtractive synth!
+
+ Copyright (C) 2016  BMP4
+
+ Developer: Vincent Berthiaume
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#ifndef sBMP4_SampledSoundCache_h
+#define sBMP4_SampledSoundCache_h
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "constants.h"
+
+//
+// SampledSoundCache
+//
+// the microbrute waves we play when k_bUseSampledSound is on, decoded the first time any plugin instance asks for
+// them. Hold it with a SharedResourcePointer: all the instances in the process then share one cache, and it goes
+// away with the last of them.
+//
+// a SamplerSound never changes once it's built and SamplerVoices only read it, so every instance adds the very same
+// sound object to its synth. Sounds are reference counted, so they live as long as a synth still uses them.
+//
+class SampledSoundCache {
+public:
+    // nullptr for the waves we don't sample, ie the sine. Decodes the wave on the first call, so don't call it on the audio thread
+    SynthesiserSound::Ptr getSound(const WaveTypes p_eWave) {
+        const ScopedLock oLock(m_oLock);
+        if (m_apSounds[p_eWave] == nullptr) {
+            m_apSounds[p_eWave] = decode(p_eWave);
+        }
+        return m_apSounds[p_eWave];
+    }
+
+private:
+    static SynthesiserSound* decode(const WaveTypes p_eWave) {
+        const char* pcName;
+        const char* pcData;
+        int iDataSize;
+        switch (p_eWave) {
+            case squareWave:
+                pcName = "microbrute pulse";
+                pcData = BinaryData::Microbrute_raw_waves_stems_sBMP4__pulse_wav;
+                iDataSize = BinaryData::Microbrute_raw_waves_stems_sBMP4__pulse_wavSize;
+                break;
+            case triangleWave:
+                pcName = "microbrute triangle";
+                pcData = BinaryData::Microbrute_raw_waves_stems_sBMP4__triangle_wav;
+                iDataSize = BinaryData::Microbrute_raw_waves_stems_sBMP4__triangle_wavSize;
+                break;
+            case sawtoothWave:
+                pcName = "microbrute sawtooth";
+                pcData = BinaryData::Microbrute_raw_waves_stems_sBMP4__sawtooth_wav;
+                iDataSize = BinaryData::Microbrute_raw_waves_stems_sBMP4__sawtooth_wavSize;
+                break;
+            default:
+                return nullptr;
+        }
+        WavAudioFormat wavFormat;
+        ScopedPointer<AudioFormatReader> audioReader(wavFormat.createReaderFor(new MemoryInputStream(pcData, iDataSize, false), true));
+        if (audioReader == nullptr) {
+            return nullptr;
+        }
+        BigInteger allNotes;
+        allNotes.setRange(0, 128, true);
+        return new SamplerSound(pcName,
+                                *audioReader,
+                                allNotes,
+                                74,   // root midi note
+                                0.1,  // attack time
+                                0.1,  // release time
+                                20.0  // maximum sample length
+                                );
+    }
+
+    CriticalSection m_oLock;
+    SynthesiserSound::Ptr m_apSounds[totalWaveTypes];
+};
+
+#endif  // sBMP4_SampledSoundCache_h
@@ -0,0 +1,130 @@
+/*
+ ==============================================================================
+ sBMP4: killer subtractive synth!
+
+ Copyright (C) 2016  BMP4
+
+ Developer: Vincent Berthiaume
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#ifndef sBMP4_SmoothedParameter_h
+#define sBMP4_SmoothedParameter_h
+
+#include <atomic>
+#include "constants.h"
+
+//
+// SmoothedParameter
+//
+// a parameter value that any thread can set, and that the audio thread follows with a linear ramp. The target is
+// a single atomic float, so setting it never blocks and never tears; everything else belongs to the audio thread,
+// which picks the target up with update() once per block and then reads the ramp a block at a time.
+//
+// a new target restarts the ramp from wherever the current value is, so automation that moves on every block just
+// keeps gliding. A ramp time of 0 makes the value jump, for switches and other parameters that can't be smoothed.
+//
+class SmoothedParameter {
+public:
+    SmoothedParameter()
+        : m_fTarget(0.f)
+        , m_fRampTarget(0.f)
+        , m_fCurrent(0.f)
+        , m_fStep(0.f)
+        , m_iStepsLeft(0)
+        , m_iRampLength(0)
+    {
+    }
+
+    // jumps to p_fValue. Not thread safe, for setting things up before the audio thread runs
+    void reset(const float p_fValue) {
+        m_fTarget.store(p_fValue, std::memory_order_relaxed);
+        m_fRampTarget = m_fCurrent = p_fValue;
+        m_iStepsLeft = 0;
+    }
+
+    // ramps take p_fRampSeconds from now on, and the current value jumps to the target
+    void prepare(const double p_dSampleRate, const float p_fRampSeconds) {
+        m_iRampLength = jmax(0, roundToInt(p_dSampleRate * p_fRampSeconds));
+        reset(getTargetValue());
+    }
+
+    // from any thread
+    void setTargetValue(const float p_fValue) {
+        m_fTarget.store(p_fValue, std::memory_order_relaxed);
+    }
+
+    float getTargetValue() const {
+        return m_fTarget.load(std::memory_order_relaxed);
+    }
+
+    //---------- everything below is for the audio thread
+
+    // picks up the latest target and starts ramping to it. Returns true if the target changed since the last call
+    bool update() {
+        const float fTarget = getTargetValue();
+        if (fTarget == m_fRampTarget) {
+            return false;
+        }
+        m_fRampTarget = fTarget;
+        if (m_iRampLength == 0) {
+            m_fCurrent = fTarget;
+            m_iStepsLeft = 0;
+        } else {
+            m_fStep = (fTarget - m_fCurrent) / m_iRampLength;
+            m_iStepsLeft = m_iRampLength;
+        }
+        return true;
+    }
+
+    bool isSmoothing() const        { return m_iStepsLeft > 0; }
+    float getCurrentValue() const   { return m_fCurrent; }
+
+    // writes the next p_iNumSamples values in p_pfDest
+    void getNextBlock(float* p_pfDest, const int p_iNumSamples) {
+        const int iNumRamp = jmin(p_iNumSamples, m_iStepsLeft);
+        for (int idx = 0; idx < iNumRamp; ++idx) {
+            p_pfDest[idx] = m_fCurrent + m_fStep * (idx + 1);
+        }
+        skip(iNumRamp);
+        FloatVectorOperations::fill(p_pfDest + iNumRamp, m_fCurrent, p_iNumSamples - iNumRamp);
+    }
+
+    // moves p_iNumSamples along the ramp and returns the value there
+    float skip(const int p_iNumSamples) {
+        if (p_iNumSamples >= m_iStepsLeft) {
+            // land exactly on the target, instead of wherever the accumulated steps end up
+            m_fCurrent = m_fRampTarget;
+            m_iStepsLeft = 0;
+        } else {
+            m_fCurrent += m_fStep * p_iNumSamples;
+            m_iStepsLeft -= p_iNumSamples;
+        }
+        return m_fCurrent;
+    }
+
+private:
+    std::atomic<float> m_fTarget;
+
+    // the target the current ramp is heading for, ie the last one update() saw
+    float m_fRampTarget;
+    float m_fCurrent;
+    float m_fStep;
+    int m_iStepsLeft;
+    int m_iRampLength;
+};
+
+#endif  // sBMP4_SmoothedParameter_h
@@ -47,77 +47,167 @@
     #define M_PI 3.14159265358979323846
 #endif
 
-// set to a large number (greater than or equal to the length of the lowest octave table) for constant table size; 
-//set to 0 for a constant oversampling ratio (each higher ocatave table length reduced by half); set somewhere
-//between (64, for instance) for constant oversampling but with a minimum limit
-#define constantRatioLimit (99999)    
-
 using namespace std;
 
-// I grabbed (and slightly modified) this code from Rabiner & Gold (1975), After Cooley, Lewis, and Welch; 
-void WaveTableOsc::fft(int N) {    
-    int i, j, k, L;            /* indexes */
-    int M, TEMP, LE, LE1, ip;  /* M = log N */
-    int NV2, NM1;
-    double t;               /* temp */
-    double Ur, Ui, Wr, Wi, Tr, Ti;
-    double Ur_old;
-    
-    // if ((N > 1) && !(N & (N - 1)))   // make sure we have a power of 2
-    NV2 = N >> 1;
-    NM1 = N - 1;
-    TEMP = N; /* get M = log N */
-    M = 0;
-    while (TEMP >>= 1){
-		++M;
-	}
-    /* shuffle */
-    j = 1;
-    for (i = 1; i <= NM1; i++) {
-        if(i<j) {             /* swap a[i] and a[j] */
-            t = m_vPartials[j-1];     
-            m_vPartials[j-1] = m_vPartials[i-1];
-            m_vPartials[i-1] = t;
-            t = m_vWave[j-1];
-            m_vWave[j-1] = m_vWave[i-1];
-            m_vWave[i-1] = t;
+//
+// getBank
+//
+// banks are cached for the lifetime of the process, keyed by (wave type, sample rate, oversample factor, min table length),
+// so that all voices and all plugin instances share the same tables instead of each running their own ffts
+//
+static CriticalSection s_oBankLock;
+static ReferenceCountedArray<WaveTableBank> s_oBanks;
+
+WaveTableBank::Ptr WaveTableBank::findBank(const WaveTypes p_eWaveType, const double p_dSampleRate, const int p_iOverSampleFactor, const int p_iMinTableLen) {
+    const ScopedLock sl(s_oBankLock);
+    for (int idx = 0; idx < s_oBanks.size(); ++idx) {
+        if (s_oBanks.getUnchecked(idx)->matches(p_eWaveType, p_dSampleRate, p_iOverSampleFactor, p_iMinTableLen)) {
+            return s_oBanks.getUnchecked(idx);
+        }
+    }
+    return nullptr;
+}
+
+WaveTableBank::Ptr WaveTableBank::getBank(const WaveTypes p_eWaveType, const double p_dSampleRate, const int p_iOverSampleFactor, const int p_iMinTableLen) {
+    if (Ptr pBank = findBank(p_eWaveType, p_dSampleRate, p_iOverSampleFactor, p_iMinTableLen)) {
+        return pBank;
+    }
+
+    //build outside of the lock so that other instances can still get their banks in the meantime
+    Ptr pNewBank = new WaveTableBank(p_eWaveType, p_dSampleRate, p_iOverSampleFactor, p_iMinTableLen);
+
+    const ScopedLock sl(s_oBankLock);
+    //someone else may have built the same bank while we were at it
+    for (int idx = 0; idx < s_oBanks.size(); ++idx) {
+        if (s_oBanks.getUnchecked(idx)->matches(p_eWaveType, p_dSampleRate, p_iOverSampleFactor, p_iMinTableLen)) {
+            return s_oBanks.getUnchecked(idx);
+        }
+    }
+    s_oBanks.add(pNewBank);
+    return pNewBank;
+}
+
+void WaveTableBank::releaseUnusedBanks() {
+    const ScopedLock sl(s_oBankLock);
+    for (int idx = s_oBanks.size(); --idx >= 0;) {
+        if (s_oBanks.getUnchecked(idx)->getReferenceCount() == 1) {
+            s_oBanks.remove(idx);
+        }
+    }
+}
+
+//==============================================================================
+WaveTableBankLoader::WaveTableBankLoader()
+    : Thread("sBMP4 wavetable loader")
+    , m_dPendingSampleRate(0.)
+{
+    for (int idx = 0; idx < totalWaveTypes; ++idx) {
+        m_apBanks[idx].store(nullptr);
+    }
+    startThread();
+}
+
+WaveTableBankLoader::~WaveTableBankLoader() {
+    stopThread(4000);
+    m_oPublishedBanks.clear();
+    WaveTableBank::releaseUnusedBanks();
+}
+
+void WaveTableBankLoader::prepare(const double p_dSampleRate) {
+    if (p_dSampleRate <= 0) {
+        return;
+    }
+    releaseStaleBanks();
+
+    //if every bank is already cached, publish them right away
+    Array<WaveTableBank::Ptr> oBanks;
+    for (int idx = 0; idx < totalWaveTypes; ++idx) {
+        WaveTableBank::Ptr pBank = WaveTableBank::findBank(static_cast<WaveTypes>(idx), p_dSampleRate);
+        if (pBank == nullptr) {
+            break;
+        }
+        oBanks.add(pBank);
+    }
+    if (oBanks.size() == totalWaveTypes) {
+        m_dPendingSampleRate.store(0.);
+        publish(oBanks);
+        return;
+    }
+
+    //otherwise build them in the background, the current banks stay in use until then
+    m_dPendingSampleRate.store(p_dSampleRate);
+    notify();
+}
+
+void WaveTableBankLoader::run() {
+    while (!threadShouldExit()) {
+        const double dSampleRate = m_dPendingSampleRate.load();
+        if (dSampleRate <= 0) {
+            wait(-1);
+            continue;
+        }
+
+        Array<WaveTableBank::Ptr> oBanks;
+        for (int idx = 0; idx < totalWaveTypes && !threadShouldExit(); ++idx) {
+            oBanks.add(WaveTableBank::getBank(static_cast<WaveTypes>(idx), dSampleRate));
+        }
+
+        //only publish if prepare() didn't ask for another rate in the meantime
+        double dExpected = dSampleRate;
+        if (oBanks.size() == totalWaveTypes && m_dPendingSampleRate.compare_exchange_strong(dExpected, 0.)) {
+            publish(oBanks);
+        }
+    }
+}
+
+void WaveTableBankLoader::publish(const Array<WaveTableBank::Ptr>& p_oBanks) {
+    const ScopedLock sl(m_oPublishLock);
+    for (int idx = 0; idx < totalWaveTypes; ++idx) {
+        WaveTableBank::Ptr pBank = p_oBanks[idx];
+        if (!m_oPublishedBanks.contains(pBank)) {
+            m_oPublishedBanks.add(pBank);
         }
-        k = NV2;             /* bit-reversed counter */
-        while(k < j) {
-            j -= k;
-            k /= 2;
-        }  
-        j += k;
-    }
-    LE = 1.;
-    for (L = 1; L <= M; L++) {            // stage L
-        LE1 = LE;                         // (LE1 = LE/2) 
-        LE *= 2;                          // (LE = 2^L)
-        Ur = 1.0;
-        Ui = 0.; 
-        Wr = cos(M_PI/(float)LE1);
-        Wi = -sin(M_PI/(float)LE1); // Cooley, Lewis, and Welch have "+" here
-        for (j = 1; j <= LE1; j++) {
-            for (i = j; i <= N; i += LE) { // butterfly
-                ip = i+LE1;
-                Tr = m_vPartials[ip-1] * Ur - m_vWave[ip-1] * Ui;
-                Ti = m_vPartials[ip-1] * Ui + m_vWave[ip-1] * Ur;
-                m_vPartials[ip-1] = m_vPartials[i-1] - Tr;
-                m_vWave[ip-1] = m_vWave[i-1] - Ti;
-                m_vPartials[i-1]  = m_vPartials[i-1] + Tr;
-                m_vWave[i-1]  = m_vWave[i-1] + Ti;
+        m_apBanks[idx].store(pBank.get(), std::memory_order_release);
+    }
+}
+
+//the voices are stopped, so they can only get the banks that are handed out right now: a pending build still
+//publishes the ones it adds, the others can go
+void WaveTableBankLoader::releaseStaleBanks() {
+    {
+        const ScopedLock sl(m_oPublishLock);
+        for (int iBank = m_oPublishedBanks.size(); --iBank >= 0;) {
+            const WaveTableBank* pBank = m_oPublishedBanks.getUnchecked(iBank).get();
+            bool bIsCurrent = false;
+            for (int idx = 0; idx < totalWaveTypes; ++idx) {
+                bIsCurrent = bIsCurrent || m_apBanks[idx].load(std::memory_order_relaxed) == pBank;
+            }
+            if (!bIsCurrent) {
+                m_oPublishedBanks.remove(iBank);
             }
-            Ur_old = Ur;
-            Ur = Ur_old * Wr - Ui * Wi;
-            Ui = Ur_old * Wi + Ui * Wr;
         }
     }
+    WaveTableBank::releaseUnusedBanks();
 }
 
-WaveTableOsc::WaveTableOsc(const int sampleRate, const WaveTypes waveType):
-	phasor(0.0)			// phase accumulator
+WaveTableOsc::WaveTableOsc():
+	phasor(0)			// phase accumulator
     , phaseInc(0.0)		// phase increment
-    , phaseOfs(0.5)		// phase offset for PWM
+    , phaseIncFixed(0)
+    , phaseOfs(0x80000000)	// phase offset for PWM, half a cycle
+    , m_pBank(nullptr)
+    , m_pCurWaveTable(nullptr)
+    , m_pNextWaveTable(nullptr)
+    , m_fNextWaveTableGain(0.f)
+    , m_eInterpolationMode(interpLinear)
+    , m_bCrossfadeMipLevels(k_bCrossfadeMipLevels)
+	{ }
+
+WaveTableBank::WaveTableBank(const WaveTypes p_eWaveType, const double p_dSampleRate, const int p_iOverSampleFactor, const int p_iMinTableLen):
+	m_eWaveType(p_eWaveType)
+    , m_dSampleRate(p_dSampleRate)
+    , m_iOverSampleFactor(p_iOverSampleFactor)
+    , m_iMinTableLen(p_iMinTableLen)
     , numWaveTables(0)	//why is this 0?
 	{
 	//initialize the array of waveTable structures (which could be replaced by vectors...)
@@ -126,9 +216,20 @@ WaveTableOsc::WaveTableOsc(const int sampleRate, const WaveTypes waveType):
         m_oWaveTables[idx].waveTableLen = 0;
     }
 
+    // a sine has a single harmonic, so it never aliases and one table is enough for every frequency
+    if (m_eWaveType == sineWave) {
+        addSineTable();
+        return;
+    }
+
+    // standard rates are baked into the binary, no need for any fft
+    if (loadBakedTables()) {
+        return;
+    }
+
 	//TODO: understand this
     // calc number of harmonics where the highest harmonic baseFreq and lowest alias an octave higher would meet
-    int maxHarms = sampleRate / (3.0 * k_iBaseFrequency) + 0.5;	//maxHarms = 735
+    int maxHarms = m_dSampleRate / (3.0 * k_iBaseFrequency) + 0.5;	//maxHarms = 735
 
 	//TODO: find less opaque way of doing this, check aspma notes
     // round up to nearest power of two, for fft size
@@ -140,18 +241,21 @@ WaveTableOsc::WaveTableOsc(const int sampleRate, const WaveTypes waveType):
     v |= v >> 8;
     v |= v >> 16;
     v++;            // and increment to power of 2
-    int tableLen = v * 2 * k_iOverSampleFactor;  // double for the sample rate, then oversampling, tablelen = 4096
-    // for ifft
-	m_vPartials = vector<double>(tableLen, 0.);
+    int tableLen = v * 2 * m_iOverSampleFactor;  // double for the sample rate, then oversampling, tablelen = 4096
+    // for ifft. Since the waves are real, only the first half of the spectrum is needed. The scratch vectors are sized
+    // for the first table, which is the longest, and the fft is rebuilt whenever the table length changes
+	ScopedPointer<RealFFT> pFFT;
+	m_vSpectrumRe = vector<double>(tableLen / 2 + 1, 0.);
+	m_vPartials = vector<double>(tableLen / 2 + 1, 0.);
 	m_vWave		= vector<double>(tableLen, 0.);
 
 	//calculate topFrequency based on Nyquist and base frequency... 
 	//TODO: why is base frequency relevant here?
-    double topFreq = k_iBaseFrequency * 2.0 / sampleRate;	//topFreq = 0.00090702947845804993
+    double topFreq = k_iBaseFrequency * 2.0 / m_dSampleRate;	//topFreq = 0.00090702947845804993
     double scale = 0.0;
     for (; maxHarms >= 1; maxHarms /= 2) {
 		//fill m_vPartials with partial amplitudes for a sawtooth. This will be ifft'ed to get a wave
-		switch (waveType){
+		switch (m_eWaveType){
 			case triangleWave:
 				JUCE_COMPILER_WARNING("these should be called something like getPartials")
 				defineTrianglePartials(tableLen, maxHarms);
@@ -168,19 +272,128 @@ WaveTableOsc::WaveTableOsc(const int sampleRate, const WaveTypes waveType):
 		}
 
 		//from the m_vPartials partials, make a wave in m_vWave, then store it in osc. keep scale so that we can reuse it for the next maxHarm, so that we have a normalized volume accross wavetables
-		scale = makeWaveTable(tableLen, scale, topFreq);
+		if (pFFT == nullptr || pFFT->getSize() != tableLen) {
+			pFFT = new RealFFT(tableLen);
+		}
+		scale = makeWaveTable(*pFFT, tableLen, scale, topFreq);
         topFreq *= 2;
-		//not sure, doesn't matter, not hit with default values
-        if (tableLen > constantRatioLimit){ // variable table size (constant oversampling but with minimum table size)
+		// each octave up has half the harmonics, so it only needs half the samples for the same oversampling.
+		// Halving stops at m_iMinTableLen; a huge m_iMinTableLen gives the same length for all tables
+        if (tableLen / 2 >= jmax(m_iMinTableLen, 4)){
             tableLen /= 2;
 		}
     }
+
+	// the scratch is only needed to build, and banks live for as long as anyone plays them
+	vector<double>().swap(m_vSpectrumRe);
+	vector<double>().swap(m_vPartials);
+	vector<double>().swap(m_vWave);
+}
+
+//
+// loadBakedTables
+//
+// looks for the tables that wavetables/bake_wavetables.py baked into BinaryData for our wave type and sample rate.
+// Returns false for rates and settings that aren't baked, in which case the constructor builds the tables itself.
+// A baked bank that should match but doesn't means the .bin files or BinaryData are stale, which asserts and logs
+// so that it doesn't go unnoticed behind the runtime build
+//
+static const int s_iBakedMagic      = 0x54574273;   // 'sBWT', little-endian
+static const int s_iBakedVersion    = 1;
+
+// referenced directly rather than through getNamedResource, so that a missing resource is a link error
+struct BakedBank {
+    WaveTypes   m_eWaveType;
+    int         m_iSampleRate;
+    const char* m_pData;
+    int         m_iDataSize;
+};
+
+#define BMP4_BAKED_BANK(wave, rate) { wave##Wave, rate, BinaryData::wavetable_##wave##_##rate##_bin, BinaryData::wavetable_##wave##_##rate##_binSize }
+static const BakedBank s_aBakedBanks[] = {
+    BMP4_BAKED_BANK(triangle,  44100), BMP4_BAKED_BANK(sawtooth,  44100), BMP4_BAKED_BANK(square,  44100),
+    BMP4_BAKED_BANK(triangle,  48000), BMP4_BAKED_BANK(sawtooth,  48000), BMP4_BAKED_BANK(square,  48000),
+    BMP4_BAKED_BANK(triangle,  88200), BMP4_BAKED_BANK(sawtooth,  88200), BMP4_BAKED_BANK(square,  88200),
+    BMP4_BAKED_BANK(triangle,  96000), BMP4_BAKED_BANK(sawtooth,  96000), BMP4_BAKED_BANK(square,  96000),
+    BMP4_BAKED_BANK(triangle, 192000), BMP4_BAKED_BANK(sawtooth, 192000), BMP4_BAKED_BANK(square, 192000),
+};
+#undef BMP4_BAKED_BANK
+
+static void reportStaleBakedBank(const WaveTypes p_eWaveType, const double p_dSampleRate, const char* p_pReason) {
+    Logger::writeToLog(String("sBMP4: baked wavetable bank for wave ") + String(static_cast<int>(p_eWaveType)) + " at "
+        + String(p_dSampleRate) + " Hz is " + p_pReason + ", building it at runtime. Rerun wavetables/bake_wavetables.py and resave sBMP4.jucer");
+    jassertfalse;
+}
+
+bool WaveTableBank::loadBakedTables() {
+    // only the default settings are baked
+    if (m_iOverSampleFactor != k_iOverSampleFactor || m_iMinTableLen != k_iMinWaveTableLen) {
+        return false;
+    }
+    const BakedBank* pBaked = nullptr;
+    for (const BakedBank& oBaked : s_aBakedBanks) {
+        if (oBaked.m_eWaveType == m_eWaveType && oBaked.m_iSampleRate == m_dSampleRate) {
+            pBaked = &oBaked;
+            break;
+        }
+    }
+    if (pBaked == nullptr) {
+        return false;
+    }
+
+    MemoryInputStream oStream(pBaked->m_pData, static_cast<size_t>(pBaked->m_iDataSize), false);
+    if (oStream.readInt() != s_iBakedMagic
+        || oStream.readInt() != s_iBakedVersion
+        || oStream.readInt() != m_eWaveType
+        || oStream.readDouble() != m_dSampleRate
+        || oStream.readInt() != m_iOverSampleFactor
+        || oStream.readInt() != m_iMinTableLen
+        || oStream.readFloat() != k_iBaseFrequency) {
+        reportStaleBakedBank(m_eWaveType, m_dSampleRate, "stale");
+        return false;
+    }
+
+    const int iNumTables = oStream.readInt();
+    if (iNumTables <= 0 || iNumTables > numWaveTableSlots) {
+        reportStaleBakedBank(m_eWaveType, m_dSampleRate, "corrupted");
+        return false;
+    }
+    vector<float> vWave;
+    for (int idx = 0; idx < iNumTables; ++idx) {
+        const double topFreq = oStream.readDouble();
+        const int len = oStream.readInt();
+        if (!isPowerOfTwo(len) || len < 4 || oStream.getNumBytesRemaining() < static_cast<int64>(len) * 4) {
+            reportStaleBakedBank(m_eWaveType, m_dSampleRate, "truncated");
+            numWaveTables = 0;
+            return false;
+        }
+        vWave.resize(len);
+        for (int iSample = 0; iSample < len; ++iSample) {
+            vWave[iSample] = oStream.readFloat();
+        }
+        addWaveTable(len, vWave, topFreq);
+    }
+    return true;
+}
+
+//
+// addSineTable
+//
+// sine banks don't need any fft: a single table, computed directly and normalized like the other waves, which covers
+// everything up to nyquist so getWaveTableIndex always returns 0 and there is nothing to crossfade
+//
+void WaveTableBank::addSineTable() {
+    vector<float> vWave(k_iSineWaveTableLen);
+    for (int idx = 0; idx < k_iSineWaveTableLen; ++idx) {
+        vWave[idx] = static_cast<float>(sin(2.0 * M_PI * idx / k_iSineWaveTableLen) * .999);
+    }
+    addWaveTable(k_iSineWaveTableLen, vWave, 0.5);
 }
 
 // if scale is 0, auto-scales
 // returns scaling factor (0.0 if failure), and wavetable in m_vWave array
-float WaveTableOsc::makeWaveTable(int len, double scale, double topFreq) {
-    fft(len);	//after this, m_vWave contains the wave form, produced by an ifft I assume, and m_vPartials contains... noise? see waveTableOscFFtOutput.xlsx in dropbox/sBMP4
+float WaveTableBank::makeWaveTable(RealFFT& p_oFFT, int len, double scale, double topFreq) {
+    p_oFFT.performInverse(&m_vSpectrumRe[0], &m_vPartials[0], &m_vWave[0]);	//after this, m_vWave contains the wave form
     //if no scale was supplied, find maximum sample amplitude, then derive scale
     if (scale == 0.0) {
         // calc normal
@@ -205,57 +418,78 @@ float WaveTableOsc::makeWaveTable(int len, double scale, double topFreq) {
 }
 
 // prepares sawtooth harmonics for ifft
-void WaveTableOsc::defineSawtoothPartials(int len, int numHarmonics){
+void WaveTableBank::defineSawtoothPartials(int len, int numHarmonics){
 	if(numHarmonics > (len / 2)){
 		numHarmonics = (len / 2);
 	}
-	for(int idx = 0; idx < len; idx++){
-		m_vWave[idx] = 0;
-		m_vPartials[idx] = 0;
-	}
-	//fill the m_vPartials vector, which I presume is the amplitude of real harmonics
-	for(int idx = 1, jdx = len - 1; idx <= numHarmonics; idx++, jdx--){
+	std::fill(m_vPartials.begin(), m_vPartials.end(), 0.);
+	//fill the m_vPartials vector, which is the imaginary part of the positive frequencies; the negative ones are implied
+	for(int idx = 1; idx <= numHarmonics; idx++){
 		double temp = -1.0 / idx;	//for sawtooh, harmonic amplitude decreases as their index increases.
-		m_vPartials[idx] = -temp;			//the firt half will be positive
-		m_vPartials[jdx] = temp;				//the second half negative... why?
+		m_vPartials[idx] = -temp;
 	}
 }
 
-// prepares sawtooth harmonics for ifft
-void WaveTableOsc::defineSquarePartials(int len, int numHarmonics) {
+// prepares square harmonics for ifft
+void WaveTableBank::defineSquarePartials(int len, int numHarmonics) {
 	if(numHarmonics > (len / 2)){
 		numHarmonics = (len / 2);
 	}
-	for(int idx = 0; idx < len; idx++){
-		m_vWave[idx] = 0;
-		m_vPartials[idx] = 0;
-	}
-	//fill the m_vPartials vector, which I presume is the amplitude of real harmonics
-	for(int idx = 1, jdx = len - 1; idx <= numHarmonics; idx++, jdx--){
+	std::fill(m_vPartials.begin(), m_vPartials.end(), 0.);
+	for(int idx = 1; idx <= numHarmonics; idx++){
 		double temp = idx & 0x01 ? 1.0 / idx : 0.0;
 		m_vPartials[idx] = -temp;
-		m_vPartials[jdx] = temp;
 	}
 }
 
-// prepares sawtooth harmonics for ifft
-void WaveTableOsc::defineTrianglePartials(int len, int numHarmonics){
+// prepares triangle harmonics for ifft
+void WaveTableBank::defineTrianglePartials(int len, int numHarmonics){
 	if(numHarmonics > (len / 2)){
 		numHarmonics = (len / 2);
 	}
-	for(int idx = 0; idx < len; idx++){
-		m_vWave[idx] = 0;
-		m_vPartials[idx] = 0;
-	}
-	//fill the m_vPartials vector, which I presume is the amplitude of real harmonics
+	std::fill(m_vPartials.begin(), m_vPartials.end(), 0.);
 	float sign = 1;
-	for(int idx = 1, jdx = len - 1; idx <= numHarmonics; idx++, jdx--){
+	for(int idx = 1; idx <= numHarmonics; idx++){
 		double temp = idx & 0x01 ? 1.0 / (idx * idx) * (sign = -sign) : 0.0;
 		m_vPartials[idx] = -temp;
-		m_vPartials[jdx] = temp;
 	}
 }
 
+//
+// getWaveTableIndex
+//
+// each table covers one octave: table idx is used while phaseInc < topFreq of table 0 * 2^idx. So instead of
+// scanning the tables, we can get the index straight from the exponent of phaseInc / (topFreq of table 0)
+//
+int WaveTableBank::getWaveTableIndex(const double phaseInc) const {
+	//TODO: why is phaseInc compared to the topFreq?
+    const double dRatio = phaseInc / m_oWaveTables[0].topFreq;
+    if (!(dRatio >= 1.0)) {
+        return 0;
+    }
+    // dRatio = mantissa * 2^iExponent, with mantissa in [0.5, 1), so floor(log2(dRatio)) + 1 == iExponent
+    int iExponent;
+    frexp(dRatio, &iExponent);
+    return jmin(iExponent, numWaveTables - 1);
+}
+
+//
+// same thing, but also returns in p_fNextGain how far phaseInc is into the octave covered by that table, ie how much
+// of the next table (the one with half the harmonics) to mix in so that mip levels crossfade instead of switching
+//
+int WaveTableBank::getWaveTableIndex(const double phaseInc, float& p_fNextGain) const {
+    const int idx = getWaveTableIndex(phaseInc);
+    p_fNextGain = 0.f;
+    if (idx + 1 < numWaveTables) {
+        // table idx covers [topFreq * 2^(idx-1), topFreq * 2^idx) of table 0, so log2(dRatio) + 1 - idx is in [0, 1)
+        // in there. For table 0 that's only true for its top octave, and below that we just don't crossfade
+        const double dRatio = phaseInc / m_oWaveTables[0].topFreq;
+        if (dRatio > 0.0) {
+            p_fNextGain = jlimit(0.f, 1.f, static_cast<float>(std::log2(dRatio) + 1.0 - idx));
+        }
+    }
+    return idx;
+}
 
 //
 // addWaveTable
@@ -266,16 +500,32 @@ void WaveTableOsc::defineTrianglePartials(int len, int numHarmonics){
 //
 // returns 0 upon success, or the number of wavetables if no more room is available
 //
-int WaveTableOsc::addWaveTable(int len, std::vector<float> waveTableIn, double topFreq) {
+int WaveTableBank::addWaveTable(int len, std::vector<float> waveTableIn, double topFreq) {
+    jassert(isPowerOfTwo(len) && len > 1);
     if (numWaveTables < numWaveTableSlots) {
-		m_oWaveTables[numWaveTables].waveTable = vector<float>(len);
-        m_oWaveTables[numWaveTables].waveTableLen = len;
-        m_oWaveTables[numWaveTables].topFreq = topFreq;
+        waveTable& table = m_oWaveTables[numWaveTables];
+		table.waveTable = vector<float>(numWaveTableGuardSamplesBefore + len + numWaveTableGuardSamplesAfter);
+        table.waveTableLen = len;
+        table.topFreq = topFreq;
+
+        // the top log2(len) bits of the phasor are the index, the remaining ones the fraction
+        int log2Len = 0;
+        while ((1 << log2Len) < len)
+            ++log2Len;
+        table.phaseShift = 32 - log2Len;
+        table.fracMask = ((uint32) 1 << table.phaseShift) - 1;
+        table.fracScale = static_cast<float>(1.0 / ((uint64) 1 << table.phaseShift));
         
-        // fill in wave
+        // fill in wave, then the guard samples: the end of the wave goes before it, and its start after it
         for (long idx = 0; idx < len; idx++){
-            m_oWaveTables[numWaveTables].waveTable[idx] = waveTableIn[idx];
+            table.waveTable[numWaveTableGuardSamplesBefore + idx] = waveTableIn[idx];
 		}
+        for (int idx = 0; idx < numWaveTableGuardSamplesBefore; idx++){
+            table.waveTable[idx] = waveTableIn[len - numWaveTableGuardSamplesBefore + idx];
+        }
+        for (int idx = 0; idx < numWaveTableGuardSamplesAfter; idx++){
+            table.waveTable[numWaveTableGuardSamplesBefore + len + idx] = waveTableIn[idx % len];
+        }
 
 		++numWaveTables;
         return 0;
@@ -283,35 +533,236 @@ int WaveTableOsc::addWaveTable(int len, std::vector<float> waveTableIn, double t
     return numWaveTables;
 }
 
+// first sample of the table proper, ie after the guard samples at the front
+static inline const float* getSamples(const waveTable& p_oTable) {
+    return &p_oTable.waveTable[numWaveTableGuardSamplesBefore];
+}
+
+//
+// Interpolator
+//
+// one specialization per InterpolationModes. Each one interpolates between p[0] and p[1] at x, in [0, 1), and can read
+// from p[-1] to p[2]: the guard samples make that safe for any index in the table. The SSE versions do the same on 4
+// samples at once; they get a pointer per lane since the 4 indices are unrelated (SSE doesn't have gathers)
+//
+template <InterpolationModes eMode> struct Interpolator;
+
+template <> struct Interpolator<interpLinear> {
+    static inline float interpolate(const float* p, const float x) {
+        return p[0] + (p[1] - p[0]) * x;
+    }
+#if BMP4_USE_SSE
+    static inline __m128 interpolate(const float* const* pp, const __m128 x) {
+        const __m128 y0 = _mm_setr_ps(pp[0][0], pp[1][0], pp[2][0], pp[3][0]);
+        const __m128 y1 = _mm_setr_ps(pp[0][1], pp[1][1], pp[2][1], pp[3][1]);
+        return _mm_add_ps(y0, _mm_mul_ps(_mm_sub_ps(y1, y0), x));
+    }
+#endif
+};
+
+// 4-point, 3rd-order Hermite (Catmull-Rom): goes through p[0] and p[1] with continuous slopes
+template <> struct Interpolator<interpHermite> {
+    static inline float interpolate(const float* p, const float x) {
+        const float c1 = 0.5f * (p[1] - p[-1]);
+        const float c2 = p[-1] - 2.5f * p[0] + 2.f * p[1] - 0.5f * p[2];
+        const float c3 = 0.5f * (p[2] - p[-1]) + 1.5f * (p[0] - p[1]);
+        return ((c3 * x + c2) * x + c1) * x + p[0];
+    }
+#if BMP4_USE_SSE
+    static inline __m128 interpolate(const float* const* pp, const __m128 x) {
+        const __m128 ym1 = _mm_setr_ps(pp[0][-1], pp[1][-1], pp[2][-1], pp[3][-1]);
+        const __m128 y0  = _mm_setr_ps(pp[0][0],  pp[1][0],  pp[2][0],  pp[3][0]);
+        const __m128 y1  = _mm_setr_ps(pp[0][1],  pp[1][1],  pp[2][1],  pp[3][1]);
+        const __m128 y2  = _mm_setr_ps(pp[0][2],  pp[1][2],  pp[2][2],  pp[3][2]);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 c1 = _mm_mul_ps(half, _mm_sub_ps(y1, ym1));
+        const __m128 c2 = _mm_sub_ps(_mm_add_ps(ym1, _mm_mul_ps(_mm_set1_ps(2.f), y1)),
+                                     _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.5f), y0), _mm_mul_ps(half, y2)));
+        const __m128 c3 = _mm_add_ps(_mm_mul_ps(half, _mm_sub_ps(y2, ym1)), _mm_mul_ps(_mm_set1_ps(1.5f), _mm_sub_ps(y0, y1)));
+        return _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c3, x), c2), x), c1), x), y0);
+    }
+#endif
+};
+
+// 4-point, 3rd-order Lagrange: the cubic going through all 4 points. A bit flatter in the passband than Hermite,
+// but its slope isn't continuous between segments
+template <> struct Interpolator<interpCubic> {
+    static inline float interpolate(const float* p, const float x) {
+        const float c1 = p[1] - (1.f / 3.f) * p[-1] - 0.5f * p[0] - (1.f / 6.f) * p[2];
+        const float c2 = 0.5f * (p[-1] + p[1]) - p[0];
+        const float c3 = (1.f / 6.f) * (p[2] - p[-1]) + 0.5f * (p[0] - p[1]);
+        return ((c3 * x + c2) * x + c1) * x + p[0];
+    }
+#if BMP4_USE_SSE
+    static inline __m128 interpolate(const float* const* pp, const __m128 x) {
+        const __m128 ym1 = _mm_setr_ps(pp[0][-1], pp[1][-1], pp[2][-1], pp[3][-1]);
+        const __m128 y0  = _mm_setr_ps(pp[0][0],  pp[1][0],  pp[2][0],  pp[3][0]);
+        const __m128 y1  = _mm_setr_ps(pp[0][1],  pp[1][1],  pp[2][1],  pp[3][1]);
+        const __m128 y2  = _mm_setr_ps(pp[0][2],  pp[1][2],  pp[2][2],  pp[3][2]);
+        const __m128 half  = _mm_set1_ps(0.5f);
+        const __m128 third = _mm_set1_ps(1.f / 3.f);
+        const __m128 sixth = _mm_set1_ps(1.f / 6.f);
+        const __m128 c1 = _mm_sub_ps(y1, _mm_add_ps(_mm_add_ps(_mm_mul_ps(third, ym1), _mm_mul_ps(half, y0)), _mm_mul_ps(sixth, y2)));
+        const __m128 c2 = _mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(ym1, y1)), y0);
+        const __m128 c3 = _mm_add_ps(_mm_mul_ps(sixth, _mm_sub_ps(y2, ym1)), _mm_mul_ps(half, _mm_sub_ps(y0, y1)));
+        return _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c3, x), c2), x), c1), x), y0);
+    }
+#endif
+};
+
+// reads p_oTable at p_uPhasor
+template <InterpolationModes eMode>
+static inline float readTable(const waveTable& p_oTable, const uint32 p_uPhasor) {
+    const float* pfSample = getSamples(p_oTable) + (p_uPhasor >> p_oTable.phaseShift);
+    const float fFrac = static_cast<float>(p_uPhasor & p_oTable.fracMask) * p_oTable.fracScale;
+    return Interpolator<eMode>::interpolate(pfSample, fFrac);
+}
+
+static float readTable(const waveTable& p_oTable, const InterpolationModes p_eMode, const uint32 p_uPhasor) {
+    switch (p_eMode) {
+        case interpHermite:
+            return readTable<interpHermite>(p_oTable, p_uPhasor);
+        case interpCubic:
+            return readTable<interpCubic>(p_oTable, p_uPhasor);
+        case interpLinear:
+        default:
+            return readTable<interpLinear>(p_oTable, p_uPhasor);
+    }
+}
+
+//
+// renderTable
+//
+// the actual block kernel: p_iNumSamples samples of p_oTable, starting at p_uPhasor, scaled by p_fGain. Returns the
+// phasor for the next sample. With SSE, 4 consecutive phases are computed and interpolated at once, then whatever
+// is left is done one sample at a time
+//
+template <InterpolationModes eMode, bool bAccumulate>
+static uint32 renderTable(const waveTable& p_oTable, uint32 p_uPhasor, const uint32 p_uPhaseInc, const float p_fGain,
+                          float* p_pfDest, const int p_iNumSamples) {
+    const float* pfTable = getSamples(p_oTable);
+    const int iPhaseShift = p_oTable.phaseShift;
+    const uint32 uFracMask = p_oTable.fracMask;
+    const float fFracScale = p_oTable.fracScale;
+    int iCurSample = 0;
+
+#if BMP4_USE_SSE
+    if (p_iNumSamples >= 4) {
+        const __m128i vShift = _mm_cvtsi32_si128(iPhaseShift);
+        const __m128i vFracMask = _mm_set1_epi32(static_cast<int>(uFracMask));
+        const __m128 vFracScale = _mm_set1_ps(fFracScale);
+        const __m128 vGain = _mm_set1_ps(p_fGain);
+        const __m128i vPhaseInc4 = _mm_set1_epi32(static_cast<int>(4 * p_uPhaseInc));
+        // integer adds wrap just like the scalar uint32 phasor does
+        __m128i vPhasor = _mm_setr_epi32(static_cast<int>(p_uPhasor), static_cast<int>(p_uPhasor + p_uPhaseInc),
+                                         static_cast<int>(p_uPhasor + 2 * p_uPhaseInc), static_cast<int>(p_uPhasor + 3 * p_uPhaseInc));
+        int32 aiIndex[4];
+        const float* apfSamples[4];
+
+        for (; iCurSample + 4 <= p_iNumSamples; iCurSample += 4) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(aiIndex), _mm_srl_epi32(vPhasor, vShift));
+            // the masked phase is < 2^31 since tables have at least 2 samples, so the signed conversion is fine
+            const __m128 vFrac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(vPhasor, vFracMask)), vFracScale);
+            for (int iLane = 0; iLane < 4; ++iLane) {
+                apfSamples[iLane] = pfTable + aiIndex[iLane];
+            }
+
+            __m128 vOut = _mm_mul_ps(Interpolator<eMode>::interpolate(apfSamples, vFrac), vGain);
+            if (bAccumulate) {
+                vOut = _mm_add_ps(vOut, _mm_loadu_ps(p_pfDest + iCurSample));
+            }
+            _mm_storeu_ps(p_pfDest + iCurSample, vOut);
+            vPhasor = _mm_add_epi32(vPhasor, vPhaseInc4);
+        }
+        p_uPhasor += static_cast<uint32>(iCurSample) * p_uPhaseInc;
+    }
+#endif
+
+    for (; iCurSample < p_iNumSamples; ++iCurSample) {
+        const float* pfSample = pfTable + (p_uPhasor >> iPhaseShift);
+        const float fFrac = static_cast<float>(p_uPhasor & uFracMask) * fFracScale;
+        const float fSample = p_fGain * Interpolator<eMode>::interpolate(pfSample, fFrac);
+        if (bAccumulate)
+            p_pfDest[iCurSample] += fSample;
+        else
+            p_pfDest[iCurSample] = fSample;
+
+        p_uPhasor += p_uPhaseInc;
+    }
+    return p_uPhasor;
+}
+
+template <bool bAccumulate>
+static uint32 renderTable(const InterpolationModes p_eMode, const waveTable& p_oTable, uint32 p_uPhasor, const uint32 p_uPhaseInc,
+                          const float p_fGain, float* p_pfDest, const int p_iNumSamples) {
+    switch (p_eMode) {
+        case interpHermite:
+            return renderTable<interpHermite, bAccumulate>(p_oTable, p_uPhasor, p_uPhaseInc, p_fGain, p_pfDest, p_iNumSamples);
+        case interpCubic:
+            return renderTable<interpCubic, bAccumulate>(p_oTable, p_uPhasor, p_uPhaseInc, p_fGain, p_pfDest, p_iNumSamples);
+        case interpLinear:
+        default:
+            return renderTable<interpLinear, bAccumulate>(p_oTable, p_uPhasor, p_uPhaseInc, p_fGain, p_pfDest, p_iNumSamples);
+    }
+}
+
+void WaveTableOsc::renderBlock(float* p_pfDest, const int p_iNumSamples) {
+    processBlock<false>(p_pfDest, p_iNumSamples, 1.f);
+}
+
+void WaveTableOsc::addBlock(float* p_pfDest, const int p_iNumSamples, const float p_fGain) {
+    processBlock<true>(p_pfDest, p_iNumSamples, p_fGain);
+}
+
+//
+// processBlock
+//
+// same as calling getOutput() then updatePhase() p_iNumSamples times, but the table lookup and the interpolation
+// mode dispatch are done once per block. There are no branches in the kernels: the phasor wraps by itself and the
+// guard samples take care of both ends of the table. When crossfading mip levels, the next table is rendered from
+// the same phase and added on top
+//
+template <bool bAccumulate>
+void WaveTableOsc::processBlock(float* p_pfDest, const int p_iNumSamples, const float p_fGain) {
+    const waveTable* waveTable = m_pCurWaveTable;
+    if (waveTable == nullptr) {
+        if (!bAccumulate) {
+            std::fill(p_pfDest, p_pfDest + p_iNumSamples, 0.f);
+        }
+        return;
+    }
+
+    const uint32 uStartPhasor = phasor;
+    const float fNextGain = (m_pNextWaveTable != nullptr) ? m_fNextWaveTableGain : 0.f;
+    phasor = renderTable<bAccumulate>(m_eInterpolationMode, *waveTable, uStartPhasor, phaseIncFixed,
+                                      p_fGain * k_fWaveTableGain * (1.f - fNextGain), p_pfDest, p_iNumSamples);
+    if (m_pNextWaveTable != nullptr) {
+        renderTable<true>(m_eInterpolationMode, *m_pNextWaveTable, uStartPhasor, phaseIncFixed,
+                          p_fGain * k_fWaveTableGain * fNextGain, p_pfDest, p_iNumSamples);
+    }
+}
+
+// reads the current table(s) at p_uPhasor, crossfading with the next mip level if needed
+float WaveTableOsc::readCurrentWaveTables(const uint32 p_uPhasor) const {
+    const float fSample = readTable(*m_pCurWaveTable, m_eInterpolationMode, p_uPhasor);
+    if (m_pNextWaveTable == nullptr) {
+        return fSample;
+    }
+    return fSample + m_fNextWaveTableGain * (readTable(*m_pNextWaveTable, m_eInterpolationMode, p_uPhasor) - fSample);
+}
+
 //
 // getOutput
 //
 // returns the current oscillator output
 //
 float WaveTableOsc::getOutput() {
-    // grab the appropriate wavetable
-    int waveTableIdx = 0;
-	//TODO: why is phaseInc compared to the topFreq?
-    while ((phaseInc >= m_oWaveTables[waveTableIdx].topFreq) && (waveTableIdx < (numWaveTables - 1))) {
-        ++waveTableIdx;
+    // the appropriate wavetable was picked in setFrequency
+    const waveTable *waveTable = m_pCurWaveTable;
+    if (waveTable == nullptr) {
+        return 0.f;
     }
-    waveTable *waveTable = &m_oWaveTables[waveTableIdx];
-
-#if !doLinearInterp
-    // truncate
-    return waveTable->waveTable[int(phasor * waveTable->waveTableLen)];
-#else
-    // linear interpolation
-    double temp = phasor * waveTable->waveTableLen;
-    int intPart = temp;
-    double fracPart = temp - intPart;
-    float samp0 = waveTable->waveTable[intPart];
-    if (++intPart >= waveTable->waveTableLen)
-        intPart = 0;
-    float samp1 = waveTable->waveTable[intPart];
-    
-    return k_fWaveTableGain * (samp0 + (samp1 - samp0) * fracPart);
-#endif
+    return k_fWaveTableGain * readCurrentWaveTables(phasor);
 }
 
 
@@ -324,42 +775,191 @@ float WaveTableOsc::getOutput() {
 // returns the current oscillator output
 //
 float WaveTableOsc::getOutputMinusOffset() {
-    // grab the appropriate wavetable
-    int waveTableIdx = 0;
-    while ((this->phaseInc >= this->m_oWaveTables[waveTableIdx].topFreq) && (waveTableIdx < (this->numWaveTables - 1))) {
-        ++waveTableIdx;
+    // the appropriate wavetable was picked in setFrequency
+    const waveTable *waveTable = m_pCurWaveTable;
+    if (waveTable == nullptr) {
+        return 0.f;
     }
-    waveTable *waveTable = &this->m_oWaveTables[waveTableIdx];
-    
-#if !doLinearInterp
-    // truncate
-    double offsetPhasor = this->phasor + this->phaseOfs;
-    if (offsetPhasor >= 1.0)
-        offsetPhasor -= 1.0;
-    return waveTable->waveTable[int(this->phasor * waveTable->waveTableLen)] - waveTable->waveTable[int(offsetPhasor * waveTable->waveTableLen)];
+
+    // the offset phasor wraps by itself too
+    const uint32 offsetPhasor = phasor + phaseOfs;
+    return k_fWaveTableGain * (readCurrentWaveTables(phasor) - readCurrentWaveTables(offsetPhasor));
+}
+
+
+WaveTableMixer::WaveTableMixer() {
+    clear();
+}
+
+void WaveTableMixer::clear() {
+    for (int iMode = 0; iMode < totalInterpolationModes; ++iMode) {
+        m_aLanes[iMode].numLanes = 0;
+    }
+}
+
+bool WaveTableMixer::isEmpty() const {
+    for (int iMode = 0; iMode < totalInterpolationModes; ++iMode) {
+        if (m_aLanes[iMode].numLanes > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void WaveTableMixer::addLane(Lanes& p_oLanes, const waveTable& p_oTable, const uint32 p_uPhasor, const uint32 p_uPhaseInc,
+                             const float p_fGain, WaveTableOsc* p_pOsc) {
+    const int idx = p_oLanes.numLanes++;
+    p_oLanes.samples[idx]      = getSamples(p_oTable);
+    p_oLanes.waveTableLen[idx] = static_cast<uint32>(p_oTable.waveTableLen);
+    p_oLanes.fracMask[idx]     = p_oTable.fracMask;
+    p_oLanes.fracScale[idx]    = p_oTable.fracScale;
+    p_oLanes.phasor[idx]       = p_uPhasor;
+    p_oLanes.phaseInc[idx]     = p_uPhaseInc;
+    p_oLanes.gain[idx]         = p_fGain;
+    p_oLanes.osc[idx]          = p_pOsc;
+}
+
+// 0 for a silent oscillator, 2 when crossfading mip levels, 1 otherwise
+int WaveTableMixer::getNumLanes(const WaveTableOsc& p_oOsc) {
+    if (p_oOsc.m_pCurWaveTable == nullptr) {
+        return 0;
+    }
+    return p_oOsc.m_pNextWaveTable != nullptr ? 2 : 1;
+}
+
+bool WaveTableMixer::add(WaveTableOsc& p_oOsc, const float p_fGain) {
+    if (m_aLanes[p_oOsc.m_eInterpolationMode].numLanes + getNumLanes(p_oOsc) > k_iMaxWaveTableMixerLanes) {
+        return false;
+    }
+    addOsc(p_oOsc, p_fGain);
+    return true;
+}
+
+bool WaveTableMixer::add(WaveTableOsc& p_oOsc1, const float p_fGain1, WaveTableOsc& p_oOsc2, const float p_fGain2) {
+    int aiNumLanes[totalInterpolationModes] = {};
+    aiNumLanes[p_oOsc1.m_eInterpolationMode] += getNumLanes(p_oOsc1);
+    aiNumLanes[p_oOsc2.m_eInterpolationMode] += getNumLanes(p_oOsc2);
+    for (int iMode = 0; iMode < totalInterpolationModes; ++iMode) {
+        if (m_aLanes[iMode].numLanes + aiNumLanes[iMode] > k_iMaxWaveTableMixerLanes) {
+            return false;
+        }
+    }
+    addOsc(p_oOsc1, p_fGain1);
+    addOsc(p_oOsc2, p_fGain2);
+    return true;
+}
+
+//
+// addOsc
+//
+// same gains as WaveTableOsc::processBlock: a crossfading oscillator gets a second lane for its next table, which
+// starts from the same phase and advances with it. The caller checked that there is room
+//
+void WaveTableMixer::addOsc(WaveTableOsc& p_oOsc, const float p_fGain) {
+    if (p_oOsc.m_pCurWaveTable == nullptr) {
+        return;     // silent, same as processBlock
+    }
+    Lanes& oLanes = m_aLanes[p_oOsc.m_eInterpolationMode];
+    const waveTable* pNextWaveTable = p_oOsc.m_pNextWaveTable;
+    const float fNextGain = (pNextWaveTable != nullptr) ? p_oOsc.m_fNextWaveTableGain : 0.f;
+    addLane(oLanes, *p_oOsc.m_pCurWaveTable, p_oOsc.phasor, p_oOsc.phaseIncFixed, p_fGain * k_fWaveTableGain * (1.f - fNextGain), &p_oOsc);
+    if (pNextWaveTable != nullptr) {
+        addLane(oLanes, *pNextWaveTable, p_oOsc.phasor, p_oOsc.phaseIncFixed, p_fGain * k_fWaveTableGain * fNextGain, nullptr);
+    }
+}
+
+void WaveTableMixer::render(float* p_pfDest, const int p_iNumSamples) {
+    for (int iStart = 0; iStart < p_iNumSamples; iStart += k_iVoiceBlockSize) {
+        const int iNumSamples = jmin(k_iVoiceBlockSize, p_iNumSamples - iStart);
+        std::fill(m_afLaneMix, m_afLaneMix + 4 * iNumSamples, 0.f);
+        renderLanes<interpLinear> (m_aLanes[interpLinear],  m_afLaneMix, iNumSamples);
+        renderLanes<interpHermite>(m_aLanes[interpHermite], m_afLaneMix, iNumSamples);
+        renderLanes<interpCubic>  (m_aLanes[interpCubic],   m_afLaneMix, iNumSamples);
+
+        float* pfDest = p_pfDest + iStart;
+        for (int iCurSample = 0; iCurSample < iNumSamples; ++iCurSample) {
+            const float* pfMix = m_afLaneMix + 4 * iCurSample;
+            pfDest[iCurSample] += (pfMix[0] + pfMix[1]) + (pfMix[2] + pfMix[3]);
+        }
+    }
+
+    for (int iMode = 0; iMode < totalInterpolationModes; ++iMode) {
+        Lanes& oLanes = m_aLanes[iMode];
+        for (int idx = 0; idx < oLanes.numLanes; ++idx) {
+            if (oLanes.osc[idx] != nullptr) {
+                oLanes.osc[idx]->phasor = oLanes.phasor[idx];
+            }
+        }
+    }
+}
+
+//
+// renderLanes
+//
+// the multi-voice kernel: lanes are taken 4 at a time, each one reading its own table at its own phase, and the 4
+// results are added to p_pfLaneMix[4 * sample + lane]. Table lengths differ from lane to lane and SSE2 has no per-lane
+// shifts, so the index is computed as the high half of phasor * len instead, which is the same as phasor >> phaseShift.
+// Without gathers, the 4 samples are then loaded one by one. The last group is padded with silent lanes
+//
+template <InterpolationModes eMode>
+void WaveTableMixer::renderLanes(Lanes& p_oLanes, float* p_pfLaneMix, const int p_iNumSamples) {
+    const int iNumLanes = p_oLanes.numLanes;
+    if (iNumLanes == 0) {
+        return;
+    }
+    for (int idx = iNumLanes; idx % 4 != 0; ++idx) {
+        p_oLanes.samples[idx]      = p_oLanes.samples[0];
+        p_oLanes.waveTableLen[idx] = p_oLanes.waveTableLen[0];
+        p_oLanes.fracMask[idx]     = p_oLanes.fracMask[0];
+        p_oLanes.fracScale[idx]    = p_oLanes.fracScale[0];
+        p_oLanes.phasor[idx]       = 0;
+        p_oLanes.phaseInc[idx]     = 0;
+        p_oLanes.gain[idx]         = 0.f;
+        p_oLanes.osc[idx]          = nullptr;
+    }
+
+    for (int iGroup = 0; iGroup < iNumLanes; iGroup += 4) {
+#if BMP4_USE_SSE
+        // local copies, so that the compiler knows the stores to p_pfLaneMix can't change them
+        const float* apfTables[4] = { p_oLanes.samples[iGroup], p_oLanes.samples[iGroup + 1], p_oLanes.samples[iGroup + 2], p_oLanes.samples[iGroup + 3] };
+        const float* apfSamples[4];
+        uint32 auIndex[4];
+        const __m128i vLen = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_oLanes.waveTableLen + iGroup));
+        const __m128i vLenOdd = _mm_srli_epi64(vLen, 32);
+        const __m128i vFracMask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_oLanes.fracMask + iGroup));
+        const __m128 vFracScale = _mm_loadu_ps(p_oLanes.fracScale + iGroup);
+        const __m128 vGain = _mm_loadu_ps(p_oLanes.gain + iGroup);
+        const __m128i vPhaseInc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_oLanes.phaseInc + iGroup));
+        __m128i vPhasor = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_oLanes.phasor + iGroup));
+
+        for (int iCurSample = 0; iCurSample < p_iNumSamples; ++iCurSample) {
+            // 32x32->64 bit products of lanes 0 and 2, then 1 and 3, and we keep their high halves
+            const __m128i vProdEven = _mm_mul_epu32(vPhasor, vLen);
+            const __m128i vProdOdd = _mm_mul_epu32(_mm_srli_epi64(vPhasor, 32), vLenOdd);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(auIndex), _mm_unpacklo_epi32(_mm_shuffle_epi32(vProdEven, _MM_SHUFFLE(3, 3, 3, 1)),
+                                                                                       _mm_shuffle_epi32(vProdOdd,  _MM_SHUFFLE(3, 3, 3, 1))));
+            for (int iLane = 0; iLane < 4; ++iLane) {
+                apfSamples[iLane] = apfTables[iLane] + auIndex[iLane];
+            }
+            // the masked phase is < 2^31 since tables have at least 2 samples, so the signed conversion is fine
+            const __m128 vFrac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(vPhasor, vFracMask)), vFracScale);
+            float* pfMix = p_pfLaneMix + 4 * iCurSample;
+            _mm_storeu_ps(pfMix, _mm_add_ps(_mm_loadu_ps(pfMix), _mm_mul_ps(Interpolator<eMode>::interpolate(apfSamples, vFrac), vGain)));
+            vPhasor = _mm_add_epi32(vPhasor, vPhaseInc);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_oLanes.phasor + iGroup), vPhasor);
 #else
-    // linear
-    double temp = this->phasor * waveTable->waveTableLen;
-    int intPart = temp;
-    double fracPart = temp - intPart;
-    float samp0 = waveTable->waveTable[intPart];
-    if (++intPart >= waveTable->waveTableLen)
-        intPart = 0;
-    float samp1 = waveTable->waveTable[intPart];
-    float samp = samp0 + (samp1 - samp0) * fracPart;
-    
-    // and linear again for the offset part
-    double offsetPhasor = this->phasor + this->phaseOfs;
-    if (offsetPhasor > 1.0)
-        offsetPhasor -= 1.0;
-    temp = offsetPhasor * waveTable->waveTableLen;
-    intPart = temp;
-    fracPart = temp - intPart;
-    samp0 = waveTable->waveTable[intPart];
-    if (++intPart >= waveTable->waveTableLen)
-        intPart = 0;
-    samp1 = waveTable->waveTable[intPart];
-    
-    return k_fWaveTableGain * (samp - (samp0 + (samp1 - samp0) * fracPart));
+        for (int iLane = 0; iLane < 4; ++iLane) {
+            const int idx = iGroup + iLane;
+            uint32 uPhasor = p_oLanes.phasor[idx];
+            for (int iCurSample = 0; iCurSample < p_iNumSamples; ++iCurSample) {
+                const float* pfSample = p_oLanes.samples[idx] + static_cast<uint32>((static_cast<uint64>(uPhasor) * p_oLanes.waveTableLen[idx]) >> 32);
+                const float fFrac = static_cast<float>(uPhasor & p_oLanes.fracMask[idx]) * p_oLanes.fracScale[idx];
+                p_pfLaneMix[4 * iCurSample + iLane] += p_oLanes.gain[idx] * Interpolator<eMode>::interpolate(pfSample, fFrac);
+                uPhasor += p_oLanes.phaseInc[idx];
+            }
+            p_oLanes.phasor[idx] = uPhasor;
+        }
 #endif
+    }
 }
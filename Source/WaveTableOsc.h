@@ -42,62 +42,265 @@
 #ifndef Test_WaveTableOsc_h
 #define Test_WaveTableOsc_h
 
-#define doLinearInterp 1
 #include <vector>
+#include <atomic>
 #include "constants.h"
+#include "RealFFT.h"
 
 //TODO: use vectors instead of an array
 typedef struct {
     double topFreq;
-    int waveTableLen;
+    int waveTableLen;       // always a power of 2
+    int phaseShift;         // phasor >> phaseShift is the index in the table
+    uint32 fracMask;        // (phasor & fracMask) * fracScale is the fraction between that index and the next one
+    float fracScale;
+    // numWaveTableGuardSamplesBefore samples copied from the end, the waveTableLen samples of the wave,
+    // then numWaveTableGuardSamplesAfter samples copied from the start
     std::vector<float> waveTable;
 } waveTable;
 
 const int numWaveTableSlots = 32;
+// so that the 4-point interpolators can read around any index without wrapping
+const int numWaveTableGuardSamplesBefore = 1;
+const int numWaveTableGuardSamplesAfter = 2;
+
+//
+// WaveTableBank
+//
+// read-only set of band-limited wavetables (one per octave) for a given wave type, sample rate,
+// oversampling factor and minimum table length. Banks are built once per process by getBank() and shared
+// by every oscillator of every plugin instance, so they must never be modified after construction.
+//
+// table sizing keeps the oversampling constant: the first table holds the most harmonics, and each table
+// after it is half as long as the previous one, down to p_iMinTableLen. Pass a large p_iMinTableLen to
+// give every octave the same length.
+//
+class WaveTableBank : public ReferenceCountedObject {
+public:
+    typedef ReferenceCountedObjectPtr<WaveTableBank> Ptr;
+
+    // returns the shared bank for these settings, building it on the first request
+    static Ptr getBank(const WaveTypes p_eWaveType, const double p_dSampleRate, const int p_iOverSampleFactor = k_iOverSampleFactor, const int p_iMinTableLen = k_iMinWaveTableLen);
+
+    // returns the shared bank for these settings if it was already built, nullptr otherwise
+    static Ptr findBank(const WaveTypes p_eWaveType, const double p_dSampleRate, const int p_iOverSampleFactor = k_iOverSampleFactor, const int p_iMinTableLen = k_iMinWaveTableLen);
+
+    // drops the cached banks that nobody else holds a reference to
+    static void releaseUnusedBanks();
+
+    int getNumWaveTables() const                        { return numWaveTables; }
+    const waveTable& getWaveTable(const int idx) const  { return m_oWaveTables[idx]; }
+
+    // index of the table with the most harmonics that won't alias at phaseInc
+    int getWaveTableIndex(const double phaseInc) const;
+    // same, plus the gain in [0, 1] of the next table when crossfading between mip levels
+    int getWaveTableIndex(const double phaseInc, float& p_fNextGain) const;
+
+    bool matches(const WaveTypes p_eWaveType, const double p_dSampleRate, const int p_iOverSampleFactor, const int p_iMinTableLen) const {
+        return m_eWaveType == p_eWaveType && m_dSampleRate == p_dSampleRate && m_iOverSampleFactor == p_iOverSampleFactor
+            && m_iMinTableLen == p_iMinTableLen;
+    }
+
+private:
+    WaveTableBank(const WaveTypes p_eWaveType, const double p_dSampleRate, const int p_iOverSampleFactor, const int p_iMinTableLen);
 
-class WaveTableOsc {
-	void fft(int N);
 	void defineSawtoothPartials(int len, int numHarmonics);
 	void defineSquarePartials(  int len, int numHarmonics);
 	void defineTrianglePartials(int len, int numHarmonics);
-	float makeWaveTable(int len, double scale, double topFreq);
+	float makeWaveTable(RealFFT& p_oFFT, int len, double scale, double topFreq);
 	int addWaveTable(	int len, std::vector<float> waveTableIn, double topFreq);
+	bool loadBakedTables();
+	void addSineTable();
+
+    const WaveTypes m_eWaveType;
+    const double m_dSampleRate;
+    const int m_iOverSampleFactor;
+    const int m_iMinTableLen;
 
-    double phasor;      // phase accumulator
-    double phaseInc;    // phase increment
-    double phaseOfs;    // phase offset for PWM
-    
     // list of wavetables
     int numWaveTables;
     waveTable m_oWaveTables[numWaveTableSlots];
-	std::vector<double> m_vPartials;	//is this real amplitude and ai imaginary amplitude?
-	std::vector<double> m_vWave; 
+
+    // ifft scratch, only used while building and freed at the end of the constructor. m_vPartials is the imaginary part of bins 0 to len/2 and
+    // m_vSpectrumRe, the real part, stays at 0 since all our waves are sums of sines
+	std::vector<double> m_vSpectrumRe;
+	std::vector<double> m_vPartials;
+	std::vector<double> m_vWave;
+
+    JUCE_DECLARE_NON_COPYABLE(WaveTableBank)
+};
+
+//
+// WaveTableBankLoader
+//
+// holds one bank per wave type for the current playback rate. prepare() is called from prepareToPlay: banks
+// that are not cached yet are built on a background thread and then published with an atomic pointer swap,
+// so the audio thread never waits for a build. Voices pick up the new banks on their next note.
+//
+// banks of earlier rates stay alive as long as a voice may still play them. prepare() expects the voices to be
+// stopped, so it drops everything but the banks currently handed out, and lets the cache free what nobody uses.
+//
+class WaveTableBankLoader : private Thread {
+public:
+    WaveTableBankLoader();
+    ~WaveTableBankLoader();
+
+    // call with all voices stopped, see above
+    void prepare(const double p_dSampleRate);
+
+    // lock-free, can be called from the audio thread. Returns nullptr until the first banks are ready
+    const WaveTableBank* getBank(const WaveTypes p_eWaveType) const {
+        return m_apBanks[p_eWaveType].load(std::memory_order_acquire);
+    }
+
+private:
+    void run() override;
+    void publish(const Array<WaveTableBank::Ptr>& p_oBanks);
+    void releaseStaleBanks();
+
+    std::atomic<const WaveTableBank*> m_apBanks[totalWaveTypes];
+    std::atomic<double> m_dPendingSampleRate;
+
+    // everything we published since the last prepare(), so that banks still used by a voice stay alive
+    Array<WaveTableBank::Ptr> m_oPublishedBanks;
+    CriticalSection m_oPublishLock;
+
+    JUCE_DECLARE_NON_COPYABLE(WaveTableBankLoader)
+};
+
+class WaveTableOsc {
+    friend class WaveTableMixer;
+
+    // phases are 32 bit fixed point, where 2^32 is a full cycle. That way they wrap by themselves and stay exact
+    uint32 phasor;          // phase accumulator
+    double phaseInc;        // phase increment, in cycles per sample
+    uint32 phaseIncFixed;   // same, in fixed point
+    uint32 phaseOfs;        // phase offset for PWM
+
+    // shared tables, see WaveTableBank. Kept alive by the WaveTableBankLoader that handed it out
+    const WaveTableBank* m_pBank;
+    // table for the current phaseInc, only updated when the bank or the frequency change
+    const waveTable* m_pCurWaveTable;
+    // when crossfading mip levels, the table above m_pCurWaveTable and how much of it to mix in. nullptr otherwise
+    const waveTable* m_pNextWaveTable;
+    float m_fNextWaveTableGain;
+    InterpolationModes m_eInterpolationMode;
+    bool m_bCrossfadeMipLevels;
     
 public:
-	WaveTableOsc(const int, const WaveTypes);
+	WaveTableOsc();
+    void  setBank(const WaveTableBank* p_pBank);
     void  setFrequency(double inc);
     void  setPhaseOffset(double offset);
     void  updatePhase(void);
     float getOutput(void);
     float getOutputMinusOffset(void);
+    const waveTable* getCurrentWaveTable() const { return m_pCurWaveTable; }
+    void  setInterpolationMode(const InterpolationModes p_eMode) { m_eInterpolationMode = p_eMode; }
+    InterpolationModes getInterpolationMode() const { return m_eInterpolationMode; }
+    // blend adjacent mip levels by octave position instead of switching tables, for clean glides. Costs a second
+    // table read per sample for most frequencies
+    void  setCrossfadeMipLevels(const bool p_bCrossfade) { m_bCrossfadeMipLevels = p_bCrossfade; updateCurrentWaveTable(); }
+    bool  getCrossfadeMipLevels() const { return m_bCrossfadeMipLevels; }
+
+    // renders p_iNumSamples consecutive samples into p_pfDest and advances the phase accordingly
+    void  renderBlock(float* p_pfDest, const int p_iNumSamples);
+    // same as renderBlock, but scales by p_fGain and adds to what's already in p_pfDest
+    void  addBlock(float* p_pfDest, const int p_iNumSamples, const float p_fGain = 1.f);
+
+private:
+    void  updateCurrentWaveTable();
+    float readCurrentWaveTables(const uint32 p_uPhasor) const;
+    template <bool bAccumulate>
+    void  processBlock(float* p_pfDest, const int p_iNumSamples, const float p_fGain);
 };
 
+//
+// WaveTableMixer
+//
+// renders a set of WaveTableOsc, eg all the voices that are playing, into a single mono mix. Oscillators are stored
+// as a structure of arrays with one lane per table read (2 for an oscillator crossfading mip levels), grouped by
+// interpolation mode, and 4 lanes are rendered per SSE instruction. So a chord of 8 voices costs 2 passes instead
+// of 8. Phases are written back to the oscillators at the end of each render() call.
+//
+class WaveTableMixer {
+public:
+    WaveTableMixer();
+
+    // removes all oscillators
+    void clear();
+    // returns false if the mixer is full, in which case p_oOsc needs to be rendered on its own
+    bool add(WaveTableOsc& p_oOsc, const float p_fGain);
+    // adds both oscillators, or neither if they don't both fit
+    bool add(WaveTableOsc& p_oOsc1, const float p_fGain1, WaveTableOsc& p_oOsc2, const float p_fGain2);
+    bool isEmpty() const;
+    // adds p_iNumSamples samples of the mix to p_pfDest. Can be called repeatedly to render consecutive blocks
+    void render(float* p_pfDest, const int p_iNumSamples);
+
+private:
+    struct Lanes {
+        int numLanes;
+        const float* samples[k_iMaxWaveTableMixerLanes];
+        uint32 waveTableLen[k_iMaxWaveTableMixerLanes];
+        uint32 fracMask[k_iMaxWaveTableMixerLanes];
+        float fracScale[k_iMaxWaveTableMixerLanes];
+        uint32 phasor[k_iMaxWaveTableMixerLanes];
+        uint32 phaseInc[k_iMaxWaveTableMixerLanes];
+        float gain[k_iMaxWaveTableMixerLanes];
+        // where to write the phasor back, nullptr for the second lane of a crossfading oscillator
+        WaveTableOsc* osc[k_iMaxWaveTableMixerLanes];
+    };
+
+    static int getNumLanes(const WaveTableOsc& p_oOsc);
+    void addOsc(WaveTableOsc& p_oOsc, const float p_fGain);
+    static void addLane(Lanes& p_oLanes, const waveTable& p_oTable, const uint32 p_uPhasor, const uint32 p_uPhaseInc,
+                        const float p_fGain, WaveTableOsc* p_pOsc);
+    template <InterpolationModes eMode>
+    static void renderLanes(Lanes& p_oLanes, float* p_pfLaneMix, const int p_iNumSamples);
+
+    Lanes m_aLanes[totalInterpolationModes];
+    // 4 interleaved partial mixes, one per SSE lane, summed into the output at the end of each block
+    float m_afLaneMix[4 * k_iVoiceBlockSize];
+
+    JUCE_DECLARE_NON_COPYABLE(WaveTableMixer)
+};
 
-// note: if you don't keep this in the range of 0-1, you'll need to make changes elsewhere
+
+inline void WaveTableOsc::setBank(const WaveTableBank* p_pBank) {
+    m_pBank = p_pBank;
+    updateCurrentWaveTable();
+}
+
+inline void WaveTableOsc::updateCurrentWaveTable() {
+    m_pNextWaveTable = nullptr;
+    m_fNextWaveTableGain = 0.f;
+    if (m_pBank == nullptr) {
+        m_pCurWaveTable = nullptr;
+    } else if (m_bCrossfadeMipLevels) {
+        const int idx = m_pBank->getWaveTableIndex(phaseInc, m_fNextWaveTableGain);
+        m_pCurWaveTable = &m_pBank->getWaveTable(idx);
+        if (m_fNextWaveTableGain > 0.f) {
+            m_pNextWaveTable = &m_pBank->getWaveTable(idx + 1);
+        }
+    } else {
+        m_pCurWaveTable = &m_pBank->getWaveTable(m_pBank->getWaveTableIndex(phaseInc));
+    }
+}
+
+// inc is in cycles per sample, ie frequency / sampleRate. It needs to stay in the range [0, 1)
 inline void WaveTableOsc::setFrequency(double inc) {
     phaseInc = inc;
+    phaseIncFixed = static_cast<uint32>(static_cast<int64>(inc * 4294967296.0));
+    updateCurrentWaveTable();
 }
 
-// note: if you don't keep this in the range of 0-1, you'll need to make changes elsewhere
+// offset is a fraction of a cycle, in the range [0, 1]
 inline void WaveTableOsc::setPhaseOffset(double offset) {
-    phaseOfs = offset;
+    phaseOfs = static_cast<uint32>(static_cast<int64>(offset * 4294967296.0));
 }
 
 inline void WaveTableOsc::updatePhase() {
-    phasor += phaseInc;
-    
-    if (phasor >= 1.0)
-        phasor -= 1.0;
+    phasor += phaseIncFixed;    // wraps around at the end of the cycle
 }
 
 #endif
@@ -28,6 +28,12 @@
 #include <string>
 #include "../JuceLibraryCode/JuceHeader.h"
 
+//same test as FloatVectorOperations, for our own SSE kernels
+#if JUCE_INTEL && ! JUCE_NO_INLINE_ASM
+ #define BMP4_USE_SSE 1
+ #include <emmintrin.h>
+#endif
+
 //#ifndef USE_SIMPLEST_LP
 //#define USE_SIMPLEST_LP 1
 //#endif
@@ -94,11 +100,49 @@ enum WaveTypes{
 	 triangleWave
 	,sawtoothWave
 	,squareWave
+	,sineWave
 	,totalWaveTypes
 };
 
+//how wavetable oscillators interpolate between table samples
+enum InterpolationModes{
+	 interpLinear
+	,interpHermite
+	,interpCubic
+	,totalInterpolationModes
+};
+
+//which voice a new note takes when all of them are playing. Voices that are already released are always taken first
+enum VoiceStealingModes{
+	 stealOldest
+	,stealQuietest
+	,stealSameNote		//the voice playing the same note if there is one, otherwise the oldest
+	,totalVoiceStealingModes
+};
+
+//the effects after the synth, see sBMP4AudioProcessor::processEffects
+enum EffectStages{
+	 effectFilter
+	,effectLfo
+	,effectGain
+	,effectDelay
+	,totalEffectStages
+};
+
+//shapes of the lfo, see BlockLfo
+enum LfoShapes{
+	 lfoSine
+	,lfoTriangle
+	,lfoSawtooth
+	,lfoSquare
+	,totalLfoShapes
+};
+
 const float k_fDefaultGain		= 0.5f;
-const float k_fDefaultDelay		= 0.0f;
+const float k_fDefaultDelay		= 0.0f;	/* delay feedback */
+const float k_fDefaultDelayTime	= 0.25f;	/* seconds */
+const float k_fMaxDelayTime		= 2.f;		/* seconds, sets the size of the delay buffer */
+const float k_fDelayTimeRampTime	= .05f;	/* seconds the delay time takes to glide to a new value */
 const float k_fDefaultWave		= 0.0f;
 
 #if USE_SIMPLEST_LP
@@ -122,15 +166,46 @@ const float k_fDefaultLfoFrHr	= 2.;
 const float k_fDefaultLfoFr01	= convertHrTo01(k_fDefaultLfoFrHr, k_fMinLfoFr, k_fMaxLfoFr);
 
 const float k_fDefaultLfoOn		= 0.;
+const LfoShapes k_eDefaultLfoShape	= lfoSine;
+const int   k_iLfoTableBits		= 10;	/* the lfo sine table has 2^k_iLfoTableBits samples */
 
 const int   k_iSimpleFilterLF = 600;
 const int   k_iSimpleFilterHF = 20000;// 12000;
-const int   k_iNumberOfVoices = 10;
+const int   k_iMinSubBlockSize = 32;	/* processBlock doesn't split blocks at midi events closer than this, see setMinSubBlockSize */
+const int   k_iMaxSubBlockSize = 256;	/* and splits them at least this often, so parameter changes land within that many samples */
+const int   k_iNumberOfVoices = 10;	/* default polyphony */
+const int   k_iMaxNumberOfVoices = 32;	/* voices we allocate, ie the max polyphony */
+const VoiceStealingModes k_eDefaultVoiceStealingMode = stealOldest;
+const WaveTypes k_eSubOscFollowsNote = totalWaveTypes;	/* as a sub osc wave, plays the note's own wave */
+const WaveTypes k_eDefaultSubOscWave = k_eSubOscFollowsNote;
+const float k_fDefaultSubOscLevel = 1.f;
 
 //-------stuff related to wavetables
-const int   k_iOverSampleFactor	= 2;     /* oversampling factor (positive integer) */
+//the banks in wavetables/ are baked with these, rerun wavetables/bake_wavetables.py after changing them
+const int   k_iOverSampleFactor	= 1;     /* oversampling factor (positive integer), 2 hides mip level switches when not crossfading */
+const bool  k_bCrossfadeMipLevels	= true;  /* blend adjacent octave tables instead of switching */
+const int   k_iMinWaveTableLen	= 64;    /* octave tables get halved down to this length */
 const float k_iBaseFrequency	= 20.f;  /* starting frequency of first table */
 const float k_fWaveTableGain	= .07f;
+const int   k_iVoiceBlockSize	= 64;    /* number of samples voices render at a time */
+const int   k_iMaxWaveTableMixerLanes	= 4 * k_iMaxNumberOfVoices;    /* table reads per interpolation mode in a WaveTableMixer, multiple of 4. Room for a crossfading osc and sub osc per voice */
+const InterpolationModes k_eDefaultInterpolationMode = interpLinear;
+const int   k_iSineWaveTableLen	= 2048;  /* a single table covers all frequencies for sine, see WaveTableBank */
+
+//-------stuff related to the amplitude envelope, times are in seconds
+const float k_fDefaultAttack	= .005f;
+const float k_fDefaultDecay		= .1f;
+const float k_fDefaultSustain	= 1.f;
+const float k_fDefaultRelease	= .05f;
+const float k_fStealFadeTime	= .005f;	/* a stolen voice fades its old note out over this while the new one starts */
+
+//-------stuff related to parameter smoothing
+const float k_fParameterRampTime	= .02f;  /* seconds gain, delay, filter and lfo take to glide to a new value */
+const int   k_iEffectsTileSize		= 32;    /* samples the effects process together, see processEffects. Also how often a gliding filter is redesigned */
+const float k_fBypassFadeTime		= .01f;  /* seconds an effect takes to fade in or out when it's bypassed or put back */
+
+//-------stuff related to additive synthesis
+const int   k_iMaxAdditivePartials	= 64;    /* needs to be a multiple of 4, for the SSE lanes */
 
 //-------stuff related to size of GUI things
 const int k_iXMargin		= 20;
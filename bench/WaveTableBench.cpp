@@ -0,0 +1,102 @@
+/*
+ ==============================================================================
+ sBMP4: killer subtractive synth!
+
+ Copyright (C) 2016  BMP4
+
+ Developer: Vincent Berthiaume
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+//
+// WaveTableBench.cpp
+//
+// interpolation benchmark: renders the same sawtooth with each interpolation mode, a block at a time the way
+// voices do, and prints how many cpu cycles each sample took. Build and run with make in this directory.
+//
+// On x86 cycles come from the time stamp counter, which ticks at a constant rate on current cpus, so pin the
+// cpu frequency for numbers that match the core clock. Elsewhere only ns per sample are reported.
+//
+
+#include <iostream>
+#include <vector>
+#include "../Source/WaveTableOsc.h"
+
+#if JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+using namespace std;
+
+static const double k_dBenchSampleRate  = 44100.;
+static const double k_dBenchFrequency   = 440.;
+static const int    k_iBenchNumSamples  = 44100 * 20;
+static const int    k_iBenchNumRuns     = 5;    // keep the best run, to filter out interruptions
+
+static uint64 readCycleCounter() {
+#if JUCE_INTEL
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void benchInterpolationMode(const WaveTableBank* p_pBank, const InterpolationModes p_eMode, const bool p_bCrossfade, vector<float>& p_vBuffer) {
+    WaveTableOsc osc;
+    osc.setBank(p_pBank);
+    osc.setInterpolationMode(p_eMode);
+    osc.setCrossfadeMipLevels(p_bCrossfade);
+    osc.setFrequency(k_dBenchFrequency / k_dBenchSampleRate);
+
+    uint64 uBestCycles = 0;
+    double dBestSeconds = 0.;
+    for (int run = 0; run < k_iBenchNumRuns; ++run) {
+        const int64 iStartTicks = Time::getHighResolutionTicks();
+        const uint64 uStartCycles = readCycleCounter();
+        for (int idx = 0; idx < k_iBenchNumSamples; idx += k_iVoiceBlockSize) {
+            osc.renderBlock(&p_vBuffer[idx], jmin(k_iVoiceBlockSize, k_iBenchNumSamples - idx));
+        }
+        const uint64 uCycles = readCycleCounter() - uStartCycles;
+        const double dSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - iStartTicks);
+        if (run == 0 || dSeconds < dBestSeconds) {
+            dBestSeconds = dSeconds;
+            uBestCycles = uCycles;
+        }
+    }
+
+    const char* modeNames[totalInterpolationModes] = { "linear", "hermite", "cubic" };
+    cout << modeNames[p_eMode] << (p_bCrossfade ? ", crossfading" : "") << ": ";
+#if JUCE_INTEL
+    cout << static_cast<double>(uBestCycles) / k_iBenchNumSamples << " cycles per sample, ";
+#endif
+    cout << dBestSeconds * 1.0e9 / k_iBenchNumSamples << " ns per sample\n";
+}
+
+int main() {
+    WaveTableBank::Ptr bank = WaveTableBank::getBank(sawtoothWave, k_dBenchSampleRate);
+    vector<float> vBuffer(k_iBenchNumSamples);
+
+    for (int mode = 0; mode < totalInterpolationModes; ++mode) {
+        for (int crossfade = 0; crossfade < 2; ++crossfade) {
+            benchInterpolationMode(bank.get(), static_cast<InterpolationModes>(mode), crossfade != 0, vBuffer);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+#!/usr/bin/env python
+#
+# bake_wavetables.py
+#
+# Bakes the band-limited triangle, sawtooth and square wavetable banks for the standard sample rates into
+# wavetable_<wave>_<rate>.bin files, next to this script. sBMP4.jucer embeds them with BinaryData, and
+# WaveTableBank loads them instead of running its ffts. Banks for any other rate are still built at runtime.
+#
+# This follows the WaveTableBank constructor step by step, so rerun it (and resave the jucer) whenever the
+# table generation or its constants change: WaveTableBank checks the header below against its own settings
+# and asserts and logs when a baked bank for a standard rate doesn't match, before building it at runtime.
+#
+# Only needs the standard library:  python wavetables/bake_wavetables.py
+# With --check, nothing is written and the exit code is 1 if any .bin file is missing or out of date.
+#
+# File format, all little-endian:
+#   int32   magic, 'sBWT'
+#   int32   version
+#   int32   wave type, as in the WaveTypes enum
+#   double  sample rate
+#   int32   oversample factor
+#   int32   min table length
+#   float   base frequency
+#   int32   number of tables, then for each table:
+#       double  topFreq
+#       int32   len
+#       float   len samples
+#
+
+import cmath
+import math
+import os
+import struct
+import sys
+
+# keep in sync with constants.h and WaveTableOsc.h
+SAMPLE_RATES    = [44100, 48000, 88200, 96000, 192000]
+OVERSAMPLE      = 1     # k_iOverSampleFactor
+MIN_TABLE_LEN   = 64    # k_iMinWaveTableLen
+BASE_FREQUENCY  = 20.0  # k_iBaseFrequency
+MAX_TABLES      = 32    # numWaveTableSlots
+
+MAGIC   = b'sBWT'
+VERSION = 1
+
+# same order as the WaveTypes enum. Sine banks are a single table computed without any fft, so they aren't baked
+WAVE_TYPES = ['triangle', 'sawtooth', 'square']
+
+
+def to_float(x):
+    """rounds a python float (a double) to single precision, like a cast to float in c++"""
+    return struct.unpack('<f', struct.pack('<f', x))[0]
+
+
+def next_power_of_two(n):
+    v = 1
+    while v < n:
+        v *= 2
+    return v
+
+
+def define_partials(wave_type, length, num_harmonics):
+    """imaginary part of bins 0 to length/2, same as WaveTableBank::define*Partials"""
+    num_harmonics = min(num_harmonics, length // 2)
+    partials = [0.0] * (length // 2 + 1)
+    if wave_type == 'sawtooth':
+        for idx in range(1, num_harmonics + 1):
+            partials[idx] = 1.0 / idx
+    elif wave_type == 'square':
+        for idx in range(1, num_harmonics + 1):
+            partials[idx] = -(1.0 / idx if idx & 1 else 0.0)
+    elif wave_type == 'triangle':
+        sign = 1.0
+        for idx in range(1, num_harmonics + 1):
+            if idx & 1:
+                sign = -sign
+                partials[idx] = -(1.0 / (idx * idx) * sign)
+    return partials
+
+
+def inverse_fft(spectrum):
+    """unnormalized in-place radix-2 complex ifft, x[n] = sum of X[k] * exp(+2 pi i k n / N)"""
+    n = len(spectrum)
+    j = 0
+    for i in range(1, n):
+        bit = n >> 1
+        while j & bit:
+            j ^= bit
+            bit >>= 1
+        j |= bit
+        if i < j:
+            spectrum[i], spectrum[j] = spectrum[j], spectrum[i]
+    size = 2
+    while size <= n:
+        step = cmath.exp(2j * math.pi / size)
+        for start in range(0, n, size):
+            w = 1.0
+            for k in range(size // 2):
+                a = spectrum[start + k]
+                b = spectrum[start + k + size // 2] * w
+                spectrum[start + k] = a + b
+                spectrum[start + k + size // 2] = a - b
+                w *= step
+        size *= 2
+    return spectrum
+
+
+def make_wave(partials, length):
+    """real wave for a half spectrum of pure imaginary partials; the imaginary part of bin length/2 is ignored"""
+    spectrum = [0j] * length
+    for k in range(1, length // 2):
+        spectrum[k] = 1j * partials[k]
+        spectrum[length - k] = -1j * partials[k]
+    return [x.real for x in inverse_fft(spectrum)]
+
+
+def bake_bank(wave_type, sample_rate):
+    """returns a list of (topFreq, samples) for one bank, same steps as the WaveTableBank constructor"""
+    max_harms = int(sample_rate / (3.0 * BASE_FREQUENCY) + 0.5)
+    table_len = next_power_of_two(max_harms) * 2 * OVERSAMPLE
+    top_freq = BASE_FREQUENCY * 2.0 / sample_rate
+    scale = 0.0
+    tables = []
+    while max_harms >= 1 and len(tables) < MAX_TABLES:
+        wave = make_wave(define_partials(wave_type, table_len, max_harms), table_len)
+        if scale == 0.0:
+            scale = 1.0 / max(abs(x) for x in wave) * .999
+        tables.append((top_freq, [to_float(x * scale) for x in wave]))
+        # makeWaveTable returns the scale as a float
+        scale = to_float(scale)
+        top_freq *= 2
+        if table_len // 2 >= max(MIN_TABLE_LEN, 4):
+            table_len //= 2
+        max_harms //= 2
+    return tables
+
+
+def serialize_bank(wave_type, sample_rate, tables):
+    data = MAGIC
+    data += struct.pack('<iidiif', VERSION, WAVE_TYPES.index(wave_type), float(sample_rate),
+                        OVERSAMPLE, MIN_TABLE_LEN, BASE_FREQUENCY)
+    data += struct.pack('<i', len(tables))
+    for top_freq, samples in tables:
+        data += struct.pack('<di', top_freq, len(samples))
+        data += struct.pack('<%df' % len(samples), *samples)
+    return data
+
+
+def main():
+    check_only = '--check' in sys.argv[1:]
+    out_dir = os.path.dirname(os.path.abspath(__file__))
+    stale = []
+    for sample_rate in SAMPLE_RATES:
+        for wave_type in WAVE_TYPES:
+            path = os.path.join(out_dir, 'wavetable_%s_%d.bin' % (wave_type, sample_rate))
+            data = serialize_bank(wave_type, sample_rate, bake_bank(wave_type, sample_rate))
+            if check_only:
+                if not os.path.exists(path) or open(path, 'rb').read() != data:
+                    stale.append(path)
+                continue
+            with open(path, 'wb') as f:
+                f.write(data)
+            print(path)
+    for path in stale:
+        print('out of date: ' + path)
+    return 1 if stale else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())